@@ -0,0 +1,18 @@
+#include "frame_block.glsl"
+#include "lights.glsl"
+
+// clustered point lights, see clustered_lights.h
+// offset and count of every cluster's lights in lightIndices
+uniform usamplerBuffer lightClusters;
+uniform usamplerBuffer lightIndices;
+
+// cluster holding a world position: screen tile from its projection, exponential slice from its view depth
+int ClusterIndex(vec3 fragPos)
+{
+    vec4 viewPosition = view * vec4(fragPos, 1.0);
+    vec4 clipPosition = projection * viewPosition;
+    vec2 ndc = clipPosition.xy / clipPosition.w;
+    ivec2 tile = clamp(ivec2((ndc * 0.5 + 0.5) * vec2(clusterGrid.xy)), ivec2(0), clusterGrid.xy - 1);
+    int slice = clamp(int(log(-viewPosition.z) * clusterScale - clusterBias), 0, clusterGrid.z - 1);
+    return (slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x;
+}
@@ -0,0 +1,20 @@
+#version 330 core
+// vertex shaders cannot drop vertices from transform feedback, so this stage only forwards the walls
+// the vertex shader found inside the frustum
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+in vec3 Offset[];
+in float Visible[];
+
+out vec3 InstanceOffset;
+
+void main()
+{
+    if (Visible[0] > 0.5)
+    {
+        InstanceOffset = Offset[0];
+        EmitVertex();
+        EndPrimitive();
+    }
+}
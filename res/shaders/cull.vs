@@ -0,0 +1,23 @@
+#version 330 core
+// one point per wall, its bounding box
+layout (location = 0) in vec3 aBoundsMin;
+layout (location = 1) in vec3 aBoundsMax;
+
+out vec3 Offset;
+out float Visible;
+
+// frustum planes as (a, b, c, d), a point p is inside when dot(plane.xyz, p) + plane.w >= 0
+uniform vec4 planes[6];
+
+void main()
+{
+    Offset = (aBoundsMin + aBoundsMax) * 0.5;
+    Visible = 1.0;
+    for (int i = 0; i < 6; i++)
+    {
+        // corner furthest along the plane normal
+        vec3 far = mix(aBoundsMin, aBoundsMax, step(vec3(0.0), planes[i].xyz));
+        if (dot(planes[i].xyz, far) + planes[i].w < 0.0)
+            Visible = 0.0;
+    }
+}
@@ -0,0 +1,23 @@
+#version 330 core
+// lights that reach the whole screen: the directional light and the flashlight
+out vec4 FragColor;
+
+#include "frame_block.glsl"
+#include "gbuffer.glsl"
+
+void main()
+{
+    float depth = GBufferDepth();
+    // nothing was drawn here, keep the clear color
+    if (depth == 1.0)
+        discard;
+
+    vec3 fragPos = GBufferPosition(depth);
+    vec3 normal;
+    Surface surface = GBufferSurface(normal);
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    vec3 result = CalcDirLight(dirLight, surface, normal, viewDir);
+    result += CalcSpotLight(spotLight, surface, normal, fragPos, viewDir);
+    FragColor = vec4(result, 1.0);
+}
@@ -7,14 +7,13 @@ out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "frame_block.glsl"
+#include "model_transform.glsl"
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    FragPos = ModelPosition(aPos);
+    Normal = ModelNormal(aNormal);
     TexCoords = aTexCoords;
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
@@ -0,0 +1,36 @@
+#version 330 core
+// lit surfaces of the forward path, point lights come from the fragment's light cluster
+out vec4 FragColor;
+
+#include "frame_block.glsl"
+#include "material.glsl"
+#include "clusters.glsl"
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+void main()
+{    
+    // properties
+    vec3 norm = normalize(Normal);
+    vec3 viewDir = normalize(viewPos - FragPos);
+    Surface surface = MaterialSurface(TexCoords);
+    
+    // == =====================================================
+    // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
+    // For each phase, a calculate function is defined that calculates the corresponding color
+    // per lamp. In the main() function we take all the calculated colors and sum them up for
+    // this fragment's final color.
+    // == =====================================================
+    // phase 1: directional lighting
+    vec3 result = CalcDirLight(dirLight, surface, norm, viewDir);
+    // phase 2: point lights, only the ones binned into this fragment's cluster
+    uvec2 cluster = texelFetch(lightClusters, ClusterIndex(FragPos)).xy;
+    for(uint i = 0u; i < cluster.y; i++)
+        result += CalcPointLight(FetchPointLight(int(texelFetch(lightIndices, int(cluster.x + i)).x)), surface, norm, FragPos, viewDir);
+    // phase 3: spot light
+    result += CalcSpotLight(spotLight, surface, norm, FragPos, viewDir);    
+    
+    FragColor = vec4(result, 1.0);
+}
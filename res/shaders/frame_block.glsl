@@ -0,0 +1,6 @@
+// camera data shared by every program, see FrameBlock in uniform_blocks.h
+layout (std140) uniform FrameBlock {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
@@ -0,0 +1,19 @@
+#version 330 core
+// geometry pass of the deferred path: surface properties only, lighting happens in screen space
+layout (location = 0) out vec4 gAlbedoSpec;
+layout (location = 1) out vec4 gNormal;
+
+#include "material.glsl"
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+void main()
+{
+    Surface surface = MaterialSurface(TexCoords);
+    // albedo in rgb, specular intensity in a
+    gAlbedoSpec = vec4(surface.albedo, surface.specular.r);
+    // normal in rgb, shininess in a
+    gNormal = vec4(normalize(Normal), surface.shininess);
+}
@@ -0,0 +1,33 @@
+#include "phong.glsl"
+
+// G-buffer of the deferred path, read back at the fragment being lit
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+
+float GBufferDepth()
+{
+    return texelFetch(gDepth, ivec2(gl_FragCoord.xy), 0).r;
+}
+
+// world position back from the depth buffer
+vec3 GBufferPosition(float depth)
+{
+    vec2 ndc = gl_FragCoord.xy / vec2(textureSize(gDepth, 0)) * 2.0 - 1.0;
+    vec4 world = inverseViewProjection * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    return world.xyz / world.w;
+}
+
+Surface GBufferSurface(out vec3 normal)
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec4 albedoSpec = texelFetch(gAlbedoSpec, texel, 0);
+    vec4 normalShininess = texelFetch(gNormal, texel, 0);
+    normal = normalize(normalShininess.xyz);
+    Surface surface;
+    surface.albedo = albedoSpec.rgb;
+    surface.specular = vec3(albedoSpec.a);
+    surface.shininess = normalShininess.a;
+    return surface;
+}
@@ -1,9 +1,17 @@
 #version 330 core
 out vec4 FragColor;
 
+#ifdef INSTANCED
+flat in vec3 Color;
+#else
 uniform vec3 CubeColor;
+#endif
 
 void main()
 {
+#ifdef INSTANCED
+    FragColor = vec4(Color, 1.0);
+#else
     FragColor = vec4(CubeColor, 1.0);
+#endif
 }
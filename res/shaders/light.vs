@@ -1,11 +1,23 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+// INSTANCED: model matrix and color per instance, for CubeBatch
+#ifdef INSTANCED
+layout (location = 4) in mat4 aModel;
+layout (location = 8) in vec3 aColor;
 
+flat out vec3 Color;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
+
+#include "frame_block.glsl"
 
 void main()
 {
+#ifdef INSTANCED
+	Color = aColor;
+	gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+#else
 	gl_Position = projection * view * model * vec4(aPos, 1.0);
+#endif
 }
@@ -0,0 +1,23 @@
+#version 330 core
+// adds one point light to the pixels its volume covers
+out vec4 FragColor;
+
+#include "frame_block.glsl"
+#include "gbuffer.glsl"
+
+flat in int LightIndex;
+
+void main()
+{
+    float depth = GBufferDepth();
+    vec3 fragPos = GBufferPosition(depth);
+    PointLight light = FetchPointLight(LightIndex);
+    // the cube is larger than the sphere
+    if (length(light.position - fragPos) >= light.radius)
+        discard;
+
+    vec3 normal;
+    Surface surface = GBufferSurface(normal);
+    vec3 viewDir = normalize(viewPos - fragPos);
+    FragColor = vec4(CalcPointLight(light, surface, normal, fragPos, viewDir), 1.0);
+}
@@ -0,0 +1,15 @@
+#version 330 core
+// one instance per point light, the unit cube grown to enclose the light's sphere
+layout (location = 0) in vec3 aPos;
+
+flat out int LightIndex;
+
+#include "frame_block.glsl"
+#include "lights.glsl"
+
+void main()
+{
+    vec4 positionRadius = texelFetch(lightData, gl_InstanceID * 4);
+    LightIndex = gl_InstanceID;
+    gl_Position = projection * view * vec4(positionRadius.xyz + aPos * 2.0 * positionRadius.w, 1.0);
+}
@@ -0,0 +1,62 @@
+// light structs are laid out for std140, every vec3 is followed by a float
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+    float radius;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+};
+
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+};
+
+layout (std140) uniform LightBlock {
+    DirLight dirLight;
+    SpotLight spotLight;
+    // tiles across, tiles down, depth slices, number of point lights
+    ivec4 clusterGrid;
+    float clusterScale;
+    float clusterBias;
+};
+
+// point lights live in a texture buffer, every light is four texels laid out as PointLight
+uniform samplerBuffer lightData;
+
+// reads point light index from the light texture buffer
+PointLight FetchPointLight(int index)
+{
+    vec4 texel0 = texelFetch(lightData, index * 4);
+    vec4 texel1 = texelFetch(lightData, index * 4 + 1);
+    vec4 texel2 = texelFetch(lightData, index * 4 + 2);
+    vec4 texel3 = texelFetch(lightData, index * 4 + 3);
+    PointLight light;
+    light.position = texel0.xyz;
+    light.radius = texel0.w;
+    light.ambient = texel1.xyz;
+    light.constant = texel1.w;
+    light.diffuse = texel2.xyz;
+    light.linear = texel2.w;
+    light.specular = texel3.xyz;
+    light.quadratic = texel3.w;
+    return light;
+}
@@ -0,0 +1,30 @@
+#include "phong.glsl"
+
+// every material texture is a layer of one texture array, a material picks its layer by index.
+// A layer holds the diffuse color in rgb and the specular intensity in a, read with a single fetch
+uniform sampler2DArray materialTextures;
+
+// SPECULAR_MAP: specular intensity from the layer's alpha, otherwise one specular color for the whole surface
+struct Material {
+    int layer;
+#ifndef SPECULAR_MAP
+    vec3 specular;
+#endif
+    float shininess;
+}; 
+
+uniform Material material;
+
+Surface MaterialSurface(vec2 texCoords)
+{
+    Surface surface;
+    vec4 texel = texture(materialTextures, vec3(texCoords, material.layer));
+    surface.albedo = texel.rgb;
+#ifdef SPECULAR_MAP
+    surface.specular = vec3(texel.a);
+#else
+    surface.specular = material.specular;
+#endif
+    surface.shininess = material.shininess;
+    return surface;
+}
@@ -0,0 +1,32 @@
+// Model transform of the lit vertex shaders, specialized for the class of transform the program draws
+// with (see transform.h) so no variant inverts a matrix per vertex:
+//   IDENTITY_TRANSFORM  vertices are already in world space, there is no model matrix
+//   GENERAL_TRANSFORM   any model matrix, normals use normalMatrix computed on the CPU
+//   neither             translation, rotation and uniform scale, the upper 3x3 of model keeps normals
+//                       perpendicular and the fragment shaders normalize them
+#ifndef IDENTITY_TRANSFORM
+uniform mat4 model;
+#endif
+#ifdef GENERAL_TRANSFORM
+uniform mat3 normalMatrix;
+#endif
+
+vec3 ModelPosition(vec3 position)
+{
+#ifdef IDENTITY_TRANSFORM
+    return position;
+#else
+    return vec3(model * vec4(position, 1.0));
+#endif
+}
+
+vec3 ModelNormal(vec3 normal)
+{
+#if defined(IDENTITY_TRANSFORM)
+    return normal;
+#elif defined(GENERAL_TRANSFORM)
+    return normalMatrix * normal;
+#else
+    return mat3(model) * normal;
+#endif
+}
@@ -2,19 +2,20 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per-instance wall position, left at (0, 0, 0) when the attribute is not enabled (player)
+layout (location = 3) in vec3 aOffset;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "frame_block.glsl"
+#include "model_transform.glsl"
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    FragPos = ModelPosition(aPos) + aOffset;
+    Normal = ModelNormal(aNormal);
     TexCoords = aTexCoords;
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
@@ -0,0 +1,235 @@
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "uniform_blocks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// texture units of the light data, the cluster grid and the light index list, after the material texture array
+const unsigned int LIGHT_DATA_TEXTURE_UNIT = 3;
+const unsigned int LIGHT_CLUSTERS_TEXTURE_UNIT = 4;
+const unsigned int LIGHT_INDICES_TEXTURE_UNIT = 5;
+
+// smallest contribution a point light is allowed to make before it is cut off
+const float LIGHT_CUTOFF = 0.02f;
+
+// distance at which the brightest channel of a light fades below LIGHT_CUTOFF, shaders fade the
+// attenuation to exactly zero there so lights only have to be binned into the clusters they reach
+inline float pointLightRadius(const PointLight& light)
+{
+    glm::vec3 peak = glm::max(light.diffuse, light.specular);
+    float intensity = std::max(std::max(peak.x, peak.y), peak.z);
+    float target = intensity / LIGHT_CUTOFF;
+    if (target <= light.constant) return 0.0f;
+    // solve quadratic * d^2 + linear * d + constant = target
+    if (light.quadratic <= 0.0f) return light.linear > 0.0f ? (target - light.constant) / light.linear : 1000.0f;
+    float discriminant = light.linear * light.linear + 4.0f * light.quadratic * (target - light.constant);
+    return (-light.linear + std::sqrt(discriminant)) / (2.0f * light.quadratic);
+}
+
+// Clustered forward lighting. The view frustum is split into CLUSTER_TILES_X x CLUSTER_TILES_Y screen tiles
+// and CLUSTER_SLICES exponential depth slices, and every point light is binned into the clusters its
+// sphere touches. Lights, the offset and count of each cluster's lights and the light index lists are
+// uploaded as texture buffers, fragment shaders find their cluster and only loop over its lights.
+class LightClusters
+{
+public:
+    static const int CLUSTER_TILES_X = 16;
+    static const int CLUSTER_TILES_Y = 9;
+    static const int CLUSTER_SLICES = 24;
+    static const int CLUSTER_COUNT = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+
+    // light/cluster pairs written by the last update
+    unsigned int Assigned;
+
+    LightClusters() : Assigned(0), lightCount(0), nearPlane(0.0f), farPlane(0.0f), boundsProjection(0.0f)
+    {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+        for (int i = 0; i < 3; i++)
+        {
+            glState.bindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            glState.bindTexture(LIGHT_DATA_TEXTURE_UNIT, GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+    }
+
+    // bins lights into the clusters of this view and uploads the result
+    void update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+    {
+        if (std::memcmp(&projection, &boundsProjection, sizeof(glm::mat4)) != 0 || nearPlane != this->nearPlane || farPlane != this->farPlane)
+        {
+            this->nearPlane = nearPlane;
+            this->farPlane = farPlane;
+            boundsProjection = projection;
+            buildClusterBounds();
+        }
+        lightCount = (int)lights.size();
+
+        // collect every light/cluster pair, then sort them by cluster with a counting pass
+        pairs.clear();
+        float depthScale = CLUSTER_SLICES / std::log(farPlane / nearPlane);
+        for (int i = 0; i < (int)lights.size(); i++)
+        {
+            const PointLight& light = lights[i];
+            glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+            float radius = light.radius;
+            // view space looks down -z, depth is the distance along it
+            float depthMin = std::max(-center.z - radius, nearPlane);
+            float depthMax = std::min(-center.z + radius, farPlane);
+            if (radius <= 0.0f || depthMin > depthMax) continue;
+
+            int sliceMin = std::clamp((int)(std::log(depthMin / nearPlane) * depthScale), 0, CLUSTER_SLICES - 1);
+            int sliceMax = std::clamp((int)(std::log(depthMax / nearPlane) * depthScale), 0, CLUSTER_SLICES - 1);
+
+            // screen rectangle of the sphere's bounding box, taken over its corners with depth clamped in front of the camera
+            float ndcMinX = 1.0f, ndcMaxX = -1.0f, ndcMinY = 1.0f, ndcMaxY = -1.0f;
+            for (int corner = 0; corner < 8; corner++)
+            {
+                float x = center.x + ((corner & 1) ? radius : -radius);
+                float y = center.y + ((corner & 2) ? radius : -radius);
+                float depth = (corner & 4) ? depthMax : depthMin;
+                float ndcX = x * projection[0][0] / depth;
+                float ndcY = y * projection[1][1] / depth;
+                ndcMinX = std::min(ndcMinX, ndcX); ndcMaxX = std::max(ndcMaxX, ndcX);
+                ndcMinY = std::min(ndcMinY, ndcY); ndcMaxY = std::max(ndcMaxY, ndcY);
+            }
+            int tileMinX = std::max((int)std::floor((ndcMinX * 0.5f + 0.5f) * CLUSTER_TILES_X), 0);
+            int tileMaxX = std::min((int)std::floor((ndcMaxX * 0.5f + 0.5f) * CLUSTER_TILES_X), CLUSTER_TILES_X - 1);
+            int tileMinY = std::max((int)std::floor((ndcMinY * 0.5f + 0.5f) * CLUSTER_TILES_Y), 0);
+            int tileMaxY = std::min((int)std::floor((ndcMaxY * 0.5f + 0.5f) * CLUSTER_TILES_Y), CLUSTER_TILES_Y - 1);
+
+            for (int z = sliceMin; z <= sliceMax; z++)
+                for (int y = tileMinY; y <= tileMaxY; y++)
+                    for (int x = tileMinX; x <= tileMaxX; x++)
+                    {
+                        int cluster = (z * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x;
+                        // the tile ranges are only a rectangle, drop the clusters the sphere misses
+                        glm::vec3 closest = glm::clamp(center, clusterMin[cluster], clusterMax[cluster]);
+                        glm::vec3 offset = closest - center;
+                        if (glm::dot(offset, offset) <= radius * radius)
+                            pairs.push_back(LightPair{ (uint32_t)cluster, (uint32_t)i });
+                    }
+        }
+        Assigned = (unsigned int)pairs.size();
+
+        clusters.assign(CLUSTER_COUNT * 2, 0);
+        for (const LightPair& pair : pairs) clusters[pair.cluster * 2 + 1]++;
+        uint32_t offset = 0;
+        for (int i = 0; i < CLUSTER_COUNT; i++)
+        {
+            clusters[i * 2] = offset;
+            offset += clusters[i * 2 + 1];
+        }
+        indices.resize(std::max<size_t>(pairs.size(), 1));
+        cursor.resize(CLUSTER_COUNT);
+        for (int i = 0; i < CLUSTER_COUNT; i++) cursor[i] = clusters[i * 2];
+        for (const LightPair& pair : pairs) indices[cursor[pair.cluster]++] = pair.light;
+
+        upload(0, lights.data(), lights.size() * sizeof(PointLight));
+        upload(1, clusters.data(), clusters.size() * sizeof(uint32_t));
+        upload(2, indices.data(), indices.size() * sizeof(uint32_t));
+    }
+
+    // writes what the shaders need to find their cluster into the light block
+    void fill(LightBlock& block) const
+    {
+        block.clusterGrid[0] = CLUSTER_TILES_X;
+        block.clusterGrid[1] = CLUSTER_TILES_Y;
+        block.clusterGrid[2] = CLUSTER_SLICES;
+        block.clusterGrid[3] = lightCount;
+        float logRange = std::log(farPlane / nearPlane);
+        block.clusterScale = CLUSTER_SLICES / logRange;
+        block.clusterBias = CLUSTER_SLICES * std::log(nearPlane) / logRange;
+    }
+
+    void bind()
+    {
+        glState.bindTexture(LIGHT_DATA_TEXTURE_UNIT, GL_TEXTURE_BUFFER, textures[0]);
+        glState.bindTexture(LIGHT_CLUSTERS_TEXTURE_UNIT, GL_TEXTURE_BUFFER, textures[1]);
+        glState.bindTexture(LIGHT_INDICES_TEXTURE_UNIT, GL_TEXTURE_BUFFER, textures[2]);
+    }
+
+    void release()
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            glState.forgetTexture(textures[i]);
+            glState.forgetBuffer(buffers[i]);
+        }
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+
+private:
+    struct LightPair {
+        uint32_t cluster;
+        uint32_t light;
+    };
+
+    // light data, cluster offset/count pairs and light indices
+    unsigned int buffers[3];
+    unsigned int textures[3];
+    int lightCount;
+    float nearPlane;
+    float farPlane;
+    // projection the cluster bounds were built for
+    glm::mat4 boundsProjection;
+    // view space bounding box of every cluster
+    std::vector<glm::vec3> clusterMin;
+    std::vector<glm::vec3> clusterMax;
+    std::vector<LightPair> pairs;
+    std::vector<uint32_t> clusters;
+    std::vector<uint32_t> indices;
+    // next free index slot of every cluster while filling the lists
+    std::vector<uint32_t> cursor;
+
+    void buildClusterBounds()
+    {
+        clusterMin.resize(CLUSTER_COUNT);
+        clusterMax.resize(CLUSTER_COUNT);
+        for (int z = 0; z < CLUSTER_SLICES; z++)
+        {
+            float depthNear = nearPlane * std::pow(farPlane / nearPlane, (float)z / CLUSTER_SLICES);
+            float depthFar = nearPlane * std::pow(farPlane / nearPlane, (float)(z + 1) / CLUSTER_SLICES);
+            for (int y = 0; y < CLUSTER_TILES_Y; y++)
+                for (int x = 0; x < CLUSTER_TILES_X; x++)
+                {
+                    glm::vec3 low(1e30f), high(-1e30f);
+                    for (int corner = 0; corner < 8; corner++)
+                    {
+                        float ndcX = (float)(x + (corner & 1)) / CLUSTER_TILES_X * 2.0f - 1.0f;
+                        float ndcY = (float)(y + ((corner >> 1) & 1)) / CLUSTER_TILES_Y * 2.0f - 1.0f;
+                        float depth = (corner & 4) ? depthFar : depthNear;
+                        glm::vec3 point(ndcX * depth / boundsProjection[0][0], ndcY * depth / boundsProjection[1][1], -depth);
+                        low = glm::min(low, point);
+                        high = glm::max(high, point);
+                    }
+                    int cluster = (z * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x;
+                    clusterMin[cluster] = low;
+                    clusterMax[cluster] = high;
+                }
+        }
+    }
+
+    // orphans the buffer and uploads size bytes, texture buffers keep pointing at the buffer
+    void upload(int index, const void* data, size_t size)
+    {
+        // texture buffers may not be empty
+        size_t storage = std::max<size_t>(size, 16);
+        glState.bindBuffer(GL_TEXTURE_BUFFER, buffers[index]);
+        glBufferData(GL_TEXTURE_BUFFER, storage, NULL, GL_STREAM_DRAW);
+        if (size > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+    }
+};
+#endif
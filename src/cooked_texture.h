@@ -0,0 +1,94 @@
+#ifndef COOKED_TEXTURE_H
+#define COOKED_TEXTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Texture container written by tools/texture_cook. Every mip level is stored in its final GPU format,
+// so loading one is a copy and nothing is decoded or generated at run time:
+//   CookedHeader | CookedLevel[levelCount] | level data
+// Numbers are little endian, offsets count from the start of the file.
+const char COOKED_MAGIC[4] = { 'C', 'T', 'E', 'X' };
+const uint32_t COOKED_VERSION = 1;
+// cooked files carry this extension in place of the image's
+const char* const COOKED_EXTENSION = ".ctex";
+
+enum CookedFormat {
+    COOKED_R8,
+    COOKED_RG8,
+    COOKED_RGB8,
+    COOKED_RGBA8,
+    // 4x4 texel blocks: BC1 opaque color, BC3 color and alpha, BC4 one channel, BC5 two channels
+    COOKED_BC1,
+    COOKED_BC3,
+    COOKED_BC4,
+    COOKED_BC5,
+    COOKED_FORMAT_COUNT
+};
+
+struct CookedHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+};
+
+struct CookedLevel {
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+    uint64_t size;
+};
+
+inline bool cookedCompressed(uint32_t format)
+{
+    return format >= COOKED_BC1 && format < COOKED_FORMAT_COUNT;
+}
+
+// bytes of one level of the given size
+inline size_t cookedLevelSize(uint32_t format, uint32_t width, uint32_t height)
+{
+    size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+    switch (format)
+    {
+    case COOKED_R8:    return (size_t)width * height;
+    case COOKED_RG8:   return (size_t)width * height * 2;
+    case COOKED_RGB8:  return (size_t)width * height * 3;
+    case COOKED_RGBA8: return (size_t)width * height * 4;
+    case COOKED_BC1:
+    case COOKED_BC4:   return blocks * 8;
+    default:           return blocks * 16;
+    }
+}
+
+// the header of a cooked file in memory, or nullptr if it is not one or is cut short
+inline const CookedHeader* cookedHeader(const unsigned char* data, size_t size)
+{
+    if (size < sizeof(CookedHeader)) return nullptr;
+    const CookedHeader* header = (const CookedHeader*)data;
+    if (std::memcmp(header->magic, COOKED_MAGIC, 4) != 0 || header->version != COOKED_VERSION) return nullptr;
+    if (header->format >= COOKED_FORMAT_COUNT || header->levelCount == 0 || header->levelCount > 32) return nullptr;
+    if (size < sizeof(CookedHeader) + header->levelCount * sizeof(CookedLevel)) return nullptr;
+    const CookedLevel* levels = (const CookedLevel*)(header + 1);
+    for (uint32_t i = 0; i < header->levelCount; i++)
+    {
+        if (levels[i].size != cookedLevelSize(header->format, levels[i].width, levels[i].height)) return nullptr;
+        if (levels[i].offset > size || levels[i].size > size - levels[i].offset) return nullptr;
+    }
+    return header;
+}
+
+// where the cooked version of an image lives: directory + file name with COOKED_EXTENSION
+inline std::string cookedPath(const std::string& directory, const std::string& imagePath)
+{
+    size_t nameStart = imagePath.find_last_of("/\\");
+    nameStart = nameStart == std::string::npos ? 0 : nameStart + 1;
+    size_t extension = imagePath.find_last_of('.');
+    if (extension == std::string::npos || extension < nameStart) extension = imagePath.size();
+    return directory + imagePath.substr(nameStart, extension - nameStart) + COOKED_EXTENSION;
+}
+#endif
@@ -0,0 +1,89 @@
+#ifndef CUBE_BATCH_H
+#define CUBE_BATCH_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "shader.h"
+#include "stream_buffer.h"
+
+#include <cstddef>
+#include <vector>
+
+// Immediate mode flat colored cubes: light cubes, markers and debug shapes. drawCube only records an
+// instance, flush writes the frame's instances into the stream buffer and draws them all with one instanced draw,
+// so any number of cubes costs one draw call. The program is the INSTANCED variant of light.vs/light.fs,
+// which reads the model matrix (locations 4-7) and the color (location 8) per instance.
+class CubeBatch
+{
+public:
+    // instances drawn by the last flush
+    unsigned int Count;
+
+    // cubeVBO holds the 36 cube vertices with a stride of 8 floats, positions first
+    CubeBatch(Shader& shader, StreamBuffer& stream, unsigned int cubeVBO) : Count(0), shader(shader), stream(stream), VAO(0)
+    {
+        glGenVertexArrays(1, &VAO);
+        glState.bindVertexArray(VAO);
+        glState.bindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        // the instance attributes are pointed at the stream buffer by every flush
+        for (unsigned int location = 4; location <= 8; location++)
+        {
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+    }
+
+    void drawCube(const glm::mat4& transform, const glm::vec3& color)
+    {
+        instances.push_back(Instance{ transform, color });
+    }
+
+    // a cube of the given size centered at position
+    void drawCube(const glm::vec3& position, float scale, const glm::vec3& color)
+    {
+        glm::mat4 transform(scale);
+        transform[3] = glm::vec4(position, 1.0f);
+        drawCube(transform, color);
+    }
+
+    // draws every cube recorded since the last flush
+    void flush()
+    {
+        Count = (unsigned int)instances.size();
+        if (instances.empty()) return;
+        GLintptr offset = stream.write(instances.data(), instances.size() * sizeof(Instance));
+
+        shader.use();
+        glState.bindVertexArray(VAO);
+        // write left the stream buffer bound, a mat4 attribute takes one location per column
+        for (unsigned int column = 0; column < 4; column++)
+            glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offset + column * sizeof(glm::vec4)));
+        glVertexAttribPointer(8, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offset + offsetof(Instance, color)));
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 36, (GLsizei)instances.size());
+        instances.clear();
+    }
+
+    void release()
+    {
+        glState.forgetVertexArray(VAO);
+        glDeleteVertexArrays(1, &VAO);
+        VAO = 0;
+    }
+
+private:
+    struct Instance {
+        glm::mat4 model;
+        glm::vec3 color;
+    };
+
+    Shader& shader;
+    StreamBuffer& stream;
+    unsigned int VAO;
+    std::vector<Instance> instances;
+};
+#endif
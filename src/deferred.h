@@ -0,0 +1,176 @@
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "clustered_lights.h"
+#include "gl_state.h"
+#include "shader.h"
+#include "shader_reloader.h"
+
+#include <iostream>
+
+// texture units the G-buffer is read from during the lighting passes, after the light texture buffers
+const unsigned int GBUFFER_ALBEDO_TEXTURE_UNIT = 6;
+const unsigned int GBUFFER_NORMAL_TEXTURE_UNIT = 7;
+const unsigned int GBUFFER_DEPTH_TEXTURE_UNIT = 8;
+
+// Deferred shading. The geometry pass writes albedo + specular, normal + shininess and depth once, then
+// lights are added in screen space: the directional light and the flashlight with one full screen
+// triangle, point lights by drawing their bounding cube, one instance per light, with additive blending.
+// Only pixels inside a light's volume pay for it. Point lights are read from the texture buffer that
+// LightClusters uploads.
+class DeferredRenderer
+{
+public:
+    unsigned int FBO;
+    unsigned int AlbedoSpec;
+    unsigned int Normal;
+    unsigned int Depth;
+    int Width;
+    int Height;
+
+    // globalShader is deferred.vs/deferred_global.fs and volumeShader light_volume.vs/light_volume.fs, both
+    // finished already
+    DeferredRenderer(Shader& globalShader, Shader& volumeShader) : FBO(0), AlbedoSpec(0), Normal(0), Depth(0), Width(0), Height(0),
+        globalShader(globalShader), volumeShader(volumeShader)
+    {
+        glGenFramebuffers(1, &FBO);
+        glGenTextures(1, &AlbedoSpec);
+        glGenTextures(1, &Normal);
+        glGenTextures(1, &Depth);
+        // the full screen triangle has no attributes, core profile still wants a vertex array bound
+        glGenVertexArrays(1, &emptyVAO);
+
+        for (Shader* program : { &globalShader, &volumeShader })
+        {
+            program->use();
+            program->setInt("gAlbedoSpec", GBUFFER_ALBEDO_TEXTURE_UNIT);
+            program->setInt("gNormal", GBUFFER_NORMAL_TEXTURE_UNIT);
+            program->setInt("gDepth", GBUFFER_DEPTH_TEXTURE_UNIT);
+        }
+        volumeShader.setInt("lightData", LIGHT_DATA_TEXTURE_UNIT);
+    }
+
+    // binds and clears the G-buffer, (re)allocating it when the framebuffer size changed
+    void beginGeometry(int width, int height)
+    {
+        if (width != Width || height != Height) resize(width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // lights the G-buffer into targetFramebuffer, which also gets the G-buffer depth so forward draws
+    // that follow are hidden correctly. lightCubeVAO holds the cube vertices at attribute 0.
+    void light(const glm::mat4& viewProjection, unsigned int lightCubeVAO, int lightCount, unsigned int targetFramebuffer = 0)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFramebuffer);
+        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glBlitFramebuffer(0, 0, Width, Height, 0, 0, Width, Height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+
+        glState.bindTexture(GBUFFER_ALBEDO_TEXTURE_UNIT, GL_TEXTURE_2D, AlbedoSpec);
+        glState.bindTexture(GBUFFER_NORMAL_TEXTURE_UNIT, GL_TEXTURE_2D, Normal);
+        glState.bindTexture(GBUFFER_DEPTH_TEXTURE_UNIT, GL_TEXTURE_2D, Depth);
+        glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+
+        // directional light and flashlight over every covered pixel
+        glDepthMask(GL_FALSE);
+        glDisable(GL_DEPTH_TEST);
+        globalShader.use();
+        globalShader.setMat4("inverseViewProjection", inverseViewProjection);
+        glState.bindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        // point lights: back faces of each volume that are behind the surface, so the camera may be inside a volume.
+        // depth clamp keeps back faces past the far plane
+        if (lightCount > 0)
+        {
+            glEnable(GL_DEPTH_TEST);
+            glDepthFunc(GL_GEQUAL);
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+            glEnable(GL_DEPTH_CLAMP);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+
+            volumeShader.use();
+            volumeShader.setMat4("inverseViewProjection", inverseViewProjection);
+            glState.bindVertexArray(lightCubeVAO);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 36, lightCount);
+
+            glDisable(GL_BLEND);
+            glDisable(GL_DEPTH_CLAMP);
+            glCullFace(GL_BACK);
+            glDisable(GL_CULL_FACE);
+            glDepthFunc(GL_LESS);
+        }
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+    }
+
+    // throwaway draws with the lighting programs, see Shader::prewarm
+    void prewarm(unsigned int lightCubeVAO)
+    {
+        globalShader.prewarm(emptyVAO);
+        volumeShader.prewarm(lightCubeVAO);
+    }
+
+    void watchShaders(ShaderReloader& reloader)
+    {
+        reloader.watch(globalShader);
+        reloader.watch(volumeShader);
+    }
+
+    void release()
+    {
+        glState.forgetTexture(AlbedoSpec);
+        glState.forgetTexture(Normal);
+        glState.forgetTexture(Depth);
+        glState.forgetVertexArray(emptyVAO);
+        glDeleteTextures(1, &AlbedoSpec);
+        glDeleteTextures(1, &Normal);
+        glDeleteTextures(1, &Depth);
+        glDeleteVertexArrays(1, &emptyVAO);
+        glDeleteFramebuffers(1, &FBO);
+        FBO = 0;
+    }
+
+private:
+    Shader& globalShader;
+    Shader& volumeShader;
+    unsigned int emptyVAO;
+
+    void resize(int width, int height)
+    {
+        Width = width;
+        Height = height;
+        allocate(AlbedoSpec, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        allocate(Normal, GL_RGBA16F, GL_RGBA, GL_FLOAT);
+        // same format as the default depth buffer, depth blits need them to match
+        allocate(Depth, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, AlbedoSpec, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, Normal, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, Depth, 0);
+        unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: G-buffer is not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void allocate(unsigned int texture, GLint internalFormat, GLenum format, GLenum type)
+    {
+        glState.bindTexture(GBUFFER_ALBEDO_TEXTURE_UNIT, GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, Width, Height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+};
+#endif
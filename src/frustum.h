@@ -0,0 +1,111 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+enum FrustumTest {
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECTS,
+    FRUSTUM_INSIDE
+};
+
+// The six planes of a view frustum, extracted from a projection * view matrix. Planes are kept as
+// separate arrays of a, b, c, d so an AABB can be tested against four planes at once with SSE.
+// The two unused slots hold a plane everything is inside of.
+class Frustum
+{
+public:
+    alignas(16) float A[8];
+    alignas(16) float B[8];
+    alignas(16) float C[8];
+    alignas(16) float D[8];
+
+    Frustum()
+    {
+        extract(glm::mat4(1.0f));
+    }
+
+    // Gribb/Hartmann: every plane is a sum or difference of the last row and one of the other rows
+    void extract(const glm::mat4& viewProjection)
+    {
+        const glm::mat4& m = viewProjection;
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        setPlane(0, row3 + row0); // left
+        setPlane(1, row3 - row0); // right
+        setPlane(2, row3 + row1); // bottom
+        setPlane(3, row3 - row1); // top
+        setPlane(4, row3 + row2); // near
+        setPlane(5, row3 - row2); // far
+        setPlane(6, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        setPlane(7, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    }
+
+    // outside if the box corner furthest along a plane normal is behind it,
+    // inside if even the nearest corner is in front of every plane
+    FrustumTest test(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+    {
+#ifdef FRUSTUM_SSE
+        __m128 minX = _mm_set1_ps(boxMin.x), minY = _mm_set1_ps(boxMin.y), minZ = _mm_set1_ps(boxMin.z);
+        __m128 maxX = _mm_set1_ps(boxMax.x), maxY = _mm_set1_ps(boxMax.y), maxZ = _mm_set1_ps(boxMax.z);
+        __m128 zero = _mm_setzero_ps();
+        int outside = 0;
+        int intersects = 0;
+        for (int i = 0; i < 8; i += 4)
+        {
+            __m128 a = _mm_load_ps(A + i), b = _mm_load_ps(B + i), c = _mm_load_ps(C + i), d = _mm_load_ps(D + i);
+            __m128 positiveA = _mm_cmpgt_ps(a, zero), positiveB = _mm_cmpgt_ps(b, zero), positiveC = _mm_cmpgt_ps(c, zero);
+            // corner furthest along the normal
+            __m128 farX = select(positiveA, maxX, minX), farY = select(positiveB, maxY, minY), farZ = select(positiveC, maxZ, minZ);
+            // corner furthest against the normal
+            __m128 nearX = select(positiveA, minX, maxX), nearY = select(positiveB, minY, maxY), nearZ = select(positiveC, minZ, maxZ);
+            __m128 farDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, farX), _mm_mul_ps(b, farY)), _mm_add_ps(_mm_mul_ps(c, farZ), d));
+            __m128 nearDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, nearX), _mm_mul_ps(b, nearY)), _mm_add_ps(_mm_mul_ps(c, nearZ), d));
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(farDistance, zero));
+            intersects |= _mm_movemask_ps(_mm_cmplt_ps(nearDistance, zero));
+        }
+        if (outside) return FRUSTUM_OUTSIDE;
+        return intersects ? FRUSTUM_INTERSECTS : FRUSTUM_INSIDE;
+#else
+        bool intersects = false;
+        for (int i = 0; i < 6; i++)
+        {
+            float farDistance = A[i] * (A[i] > 0.0f ? boxMax.x : boxMin.x) + B[i] * (B[i] > 0.0f ? boxMax.y : boxMin.y) + C[i] * (C[i] > 0.0f ? boxMax.z : boxMin.z) + D[i];
+            if (farDistance < 0.0f) return FRUSTUM_OUTSIDE;
+            float nearDistance = A[i] * (A[i] > 0.0f ? boxMin.x : boxMax.x) + B[i] * (B[i] > 0.0f ? boxMin.y : boxMax.y) + C[i] * (C[i] > 0.0f ? boxMin.z : boxMax.z) + D[i];
+            if (nearDistance < 0.0f) intersects = true;
+        }
+        return intersects ? FRUSTUM_INTERSECTS : FRUSTUM_INSIDE;
+#endif
+    }
+
+    bool visible(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+    {
+        return test(boxMin, boxMax) != FRUSTUM_OUTSIDE;
+    }
+
+private:
+    void setPlane(int i, glm::vec4 plane)
+    {
+        A[i] = plane.x;
+        B[i] = plane.y;
+        C[i] = plane.z;
+        D[i] = plane.w;
+    }
+
+#ifdef FRUSTUM_SSE
+    static __m128 select(__m128 mask, __m128 ifTrue, __m128 ifFalse)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, ifTrue), _mm_andnot_ps(mask, ifFalse));
+    }
+#endif
+};
+#endif
@@ -0,0 +1,189 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/gl.h>
+
+// texture units mirrored by the cache, binds to higher units always go through
+const unsigned int GL_STATE_TEXTURE_UNITS = 16;
+
+// Mirror of the GL binding state that drops calls which would not change anything.
+// Everything that binds programs, vertex arrays, buffers or textures has to go through glState,
+// otherwise the mirror goes stale. Deleting a bound object resets its binding to 0 in GL, so
+// deletions have to be reported with the forget* functions.
+class GLState
+{
+public:
+    struct Counters {
+        unsigned int issued;
+        unsigned int elided;
+    };
+
+    // counters of the frame being recorded and of the last finished frame
+    Counters Frame;
+    Counters LastFrame;
+
+    GLState()
+    {
+        LastFrame = Frame = Counters{ 0, 0 };
+        invalidate();
+    }
+
+    // call at the start of every frame
+    void beginFrame()
+    {
+        LastFrame = Frame;
+        Frame = Counters{ 0, 0 };
+    }
+
+    // forgets everything, for when GL state was changed behind the cache's back
+    void invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        for (unsigned int i = 0; i < BUFFER_TARGETS; i++) buffers[i] = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+            for (unsigned int i = 0; i < TEXTURE_TARGETS; i++)
+                textures[unit][i] = UNKNOWN;
+    }
+
+    void useProgram(unsigned int id)
+    {
+        if (!changed(program, id)) return;
+        glUseProgram(id);
+    }
+
+    void bindVertexArray(unsigned int id)
+    {
+        if (!changed(vertexArray, id)) return;
+        glBindVertexArray(id);
+    }
+
+    void bindBuffer(GLenum target, unsigned int id)
+    {
+        int slot = bufferSlot(target);
+        // element array bindings belong to the bound vertex array, those are never cached
+        if (slot < 0) { count(true); glBindBuffer(target, id); return; }
+        if (!changed(buffers[slot], id)) return;
+        glBindBuffer(target, id);
+    }
+
+    // binds a whole buffer to an indexed binding point, this also changes the generic binding of target
+    void bindBufferBase(GLenum target, unsigned int index, unsigned int id)
+    {
+        count(true);
+        glBindBufferBase(target, index, id);
+        int slot = bufferSlot(target);
+        if (slot >= 0) buffers[slot] = id;
+    }
+
+    void bindBufferRange(GLenum target, unsigned int index, unsigned int id, GLintptr offset, GLsizeiptr size)
+    {
+        count(true);
+        glBindBufferRange(target, index, id, offset, size);
+        int slot = bufferSlot(target);
+        if (slot >= 0) buffers[slot] = id;
+    }
+
+    void activeTexture(unsigned int unit)
+    {
+        if (!changed(activeUnit, unit)) return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // binds a texture to a unit, switching the active unit only when the binding has to change
+    void bindTexture(unsigned int unit, GLenum target, unsigned int id)
+    {
+        int slot = textureSlot(target);
+        if (unit >= GL_STATE_TEXTURE_UNITS || slot < 0)
+        {
+            activeTexture(unit);
+            count(true);
+            glBindTexture(target, id);
+            return;
+        }
+        if (textures[unit][slot] == id) { count(false); return; }
+        activeTexture(unit);
+        count(true);
+        glBindTexture(target, id);
+        textures[unit][slot] = id;
+    }
+
+    void forgetProgram(unsigned int id)
+    {
+        if (program == id) program = UNKNOWN;
+    }
+
+    void forgetVertexArray(unsigned int id)
+    {
+        if (vertexArray == id) vertexArray = UNKNOWN;
+    }
+
+    void forgetBuffer(unsigned int id)
+    {
+        for (unsigned int i = 0; i < BUFFER_TARGETS; i++)
+            if (buffers[i] == id) buffers[i] = UNKNOWN;
+    }
+
+    void forgetTexture(unsigned int id)
+    {
+        for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+            for (unsigned int i = 0; i < TEXTURE_TARGETS; i++)
+                if (textures[unit][i] == id) textures[unit][i] = UNKNOWN;
+    }
+
+private:
+    static const unsigned int UNKNOWN = 0xFFFFFFFFu;
+    static const unsigned int BUFFER_TARGETS = 7;
+    static const unsigned int TEXTURE_TARGETS = 4;
+
+    unsigned int program;
+    unsigned int vertexArray;
+    unsigned int buffers[BUFFER_TARGETS];
+    unsigned int activeUnit;
+    unsigned int textures[GL_STATE_TEXTURE_UNITS][TEXTURE_TARGETS];
+
+    void count(bool issued)
+    {
+        if (issued) Frame.issued++;
+        else Frame.elided++;
+    }
+
+    bool changed(unsigned int& current, unsigned int id)
+    {
+        bool differs = current != id;
+        count(differs);
+        current = id;
+        return differs;
+    }
+
+    static int bufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER:              return 0;
+        case GL_UNIFORM_BUFFER:            return 1;
+        case GL_TEXTURE_BUFFER:            return 2;
+        case GL_PIXEL_UNPACK_BUFFER:       return 3;
+        case GL_PIXEL_PACK_BUFFER:         return 4;
+        case GL_COPY_READ_BUFFER:          return 5;
+        case GL_TRANSFORM_FEEDBACK_BUFFER: return 6;
+        default:                           return -1;
+        }
+    }
+
+    static int textureSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D:       return 0;
+        case GL_TEXTURE_2D_ARRAY: return 1;
+        case GL_TEXTURE_BUFFER:   return 2;
+        case GL_TEXTURE_CUBE_MAP: return 3;
+        default:                  return -1;
+        }
+    }
+};
+
+GLState glState;
+#endif
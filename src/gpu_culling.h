@@ -0,0 +1,160 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "frustum.h"
+#include "gl_state.h"
+#include "map.h"
+#include "shader.h"
+
+#include <vector>
+
+// Frustum culling of the wall instances on the GPU. Every wall is one point holding its bounding box,
+// the cull program tests it against the frustum and transform feedback captures the offsets of the
+// walls in view. The number of walls captured is only known through a query, so two output buffers
+// are used: one is drawn with its known count while the other one is being filled, and they are swapped
+// once its query result arrived, which is usually the next frame. The CPU only walks the map when it changes.
+class GpuWallCulling
+{
+public:
+    // number of walls in the buffer drawn this frame
+    unsigned int Count;
+    // number of wall cells in the labyrinth
+    unsigned int Total;
+
+    // cullShader is the cull.vs/cull.gs feedback program capturing InstanceOffset, it only has to be finished
+    // by the first cull. cubeVBO holds the cube vertices, laid out as cubeVertices
+    GpuWallCulling(Shader& cullShader, unsigned int cubeVBO) : Count(0), Total(0), cullShader(cullShader),
+        ready(-1), pending(-1), revision(0), built(false)
+    {
+        glGenBuffers(1, &boundsVBO);
+        glGenVertexArrays(1, &boundsVAO);
+        glState.bindVertexArray(boundsVAO);
+        glState.bindBuffer(GL_ARRAY_BUFFER, boundsVBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)sizeof(glm::vec3));
+        glEnableVertexAttribArray(1);
+
+        glGenBuffers(2, offsetVBO);
+        glGenVertexArrays(2, drawVAO);
+        glGenQueries(2, queries);
+        for (int i = 0; i < 2; i++)
+        {
+            glState.bindVertexArray(drawVAO[i]);
+            glState.bindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+            glEnableVertexAttribArray(2);
+            // per-instance offset, read from the transform feedback output
+            glState.bindBuffer(GL_ARRAY_BUFFER, offsetVBO[i]);
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+            glEnableVertexAttribArray(3);
+            glVertexAttribDivisor(3, 1);
+        }
+    }
+
+    // rebuilds the wall boxes if the map changed since the last call
+    void update()
+    {
+        if (built && revision == mapRevision) return;
+
+        std::vector<glm::vec3> bounds;
+        for (int i = 0; i < (int)labyrinth.size(); i++) {
+            for (int j = 0; j < (int)labyrinth[i].size(); j++) {
+                if (labyrinth[i][j] == 0) continue;
+                bounds.push_back(glm::vec3((float)j, 0.0f, (float)i));
+                bounds.push_back(glm::vec3(j + BLOCK_SIDE, BLOCK_SIDE, i + BLOCK_SIDE));
+            }
+        }
+        Total = (unsigned int)bounds.size() / 2;
+
+        glState.bindBuffer(GL_ARRAY_BUFFER, boundsVBO);
+        glBufferData(GL_ARRAY_BUFFER, bounds.size() * sizeof(glm::vec3), bounds.data(), GL_STATIC_DRAW);
+        // outputs can hold every wall, a pass in flight was built from the old walls and is dropped
+        for (int i = 0; i < 2; i++)
+        {
+            glState.bindBuffer(GL_ARRAY_BUFFER, offsetVBO[i]);
+            glBufferData(GL_ARRAY_BUFFER, Total * sizeof(glm::vec3), NULL, GL_DYNAMIC_COPY);
+        }
+        ready = pending = -1;
+        Count = 0;
+
+        revision = mapRevision;
+        built = true;
+    }
+
+    // picks up the result of the pass in flight, if any, and starts a new one when none is in flight
+    void cull(const Frustum& frustum)
+    {
+        if (pending >= 0)
+        {
+            GLuint available = 0;
+            glGetQueryObjectuiv(queries[pending], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) return;
+            GLuint written = 0;
+            glGetQueryObjectuiv(queries[pending], GL_QUERY_RESULT, &written);
+            ready = pending;
+            Count = written;
+            pending = -1;
+        }
+        if (Total == 0) return;
+
+        pending = ready == 0 ? 1 : 0;
+        cullShader.use();
+        glm::vec4 planes[6];
+        for (int i = 0; i < 6; i++) planes[i] = glm::vec4(frustum.A[i], frustum.B[i], frustum.C[i], frustum.D[i]);
+        cullShader.setVec4Array("planes", planes, 6);
+        glState.bindVertexArray(boundsVAO);
+        glState.bindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, offsetVBO[pending]);
+
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, queries[pending]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, Total);
+        glEndTransformFeedback();
+        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+        glDisable(GL_RASTERIZER_DISCARD);
+    }
+
+    // vertex array to draw the walls in view with, Count instances of the cube
+    unsigned int VAO() const
+    {
+        return ready >= 0 ? drawVAO[ready] : 0;
+    }
+
+    void release()
+    {
+        glState.forgetVertexArray(boundsVAO);
+        glState.forgetBuffer(boundsVBO);
+        glDeleteVertexArrays(1, &boundsVAO);
+        glDeleteBuffers(1, &boundsVBO);
+        for (int i = 0; i < 2; i++)
+        {
+            glState.forgetVertexArray(drawVAO[i]);
+            glState.forgetBuffer(offsetVBO[i]);
+        }
+        glDeleteVertexArrays(2, drawVAO);
+        glDeleteBuffers(2, offsetVBO);
+        glDeleteQueries(2, queries);
+        ready = pending = -1;
+        Count = 0;
+    }
+
+private:
+    Shader& cullShader;
+    unsigned int boundsVBO, boundsVAO;
+    unsigned int offsetVBO[2], drawVAO[2];
+    unsigned int queries[2];
+    // output buffer drawn from, and output buffer being written, -1 for none
+    int ready;
+    int pending;
+    unsigned int revision;
+    bool built;
+};
+#endif
@@ -0,0 +1,157 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/gl.h>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <cstring>
+#include <iostream>
+
+// GL 3.3 core context without a window or a display server, for benchmark runs on CI machines and servers.
+// The context is created through EGL on the surfaceless platform (Mesa, llvmpipe when there is no GPU), or on
+// the first EGL device (drivers with EGL_EXT_platform_device), and has no default framebuffer: frames are
+// rendered into FBO, a Width x Height color and depth/stencil target. Needs the build to find EGL (HAVE_EGL).
+class HeadlessContext
+{
+public:
+    unsigned int FBO;
+    int Width;
+    int Height;
+
+    HeadlessContext() : FBO(0), Width(0), Height(0)
+    {
+    }
+
+    // creates the context, makes it current, loads GL through glad and binds a framebuffer of the given size
+    bool create(int width, int height)
+    {
+#ifdef HAVE_EGL
+        display = openDisplay();
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+        {
+            std::cout << "ERROR::HEADLESS::NO_EGL_DISPLAY" << std::endl;
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API))
+        {
+            std::cout << "ERROR::HEADLESS::NO_DESKTOP_GL" << std::endl;
+            return false;
+        }
+        // nothing is ever drawn to an EGL surface, any surface type will do
+        const EGLint configAttributes[] = { EGL_SURFACE_TYPE, 0, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config;
+        EGLint configs = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configs) || configs == 0)
+        {
+            std::cout << "ERROR::HEADLESS::NO_EGL_CONFIG" << std::endl;
+            return false;
+        }
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        // no surfaces at all, needs EGL_KHR_surfaceless_context
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            std::cout << "ERROR::HEADLESS::CONTEXT_CREATION_FAILED: 0x" << std::hex << eglGetError() << std::dec << std::endl;
+            return false;
+        }
+        if (!gladLoadGL(getProcAddress))
+        {
+            std::cout << "ERROR::HEADLESS::GLAD_LOAD_FAILED" << std::endl;
+            return false;
+        }
+
+        Width = width;
+        Height = height;
+        glGenRenderbuffers(2, renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "ERROR::HEADLESS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+            return false;
+        }
+        glViewport(0, 0, width, height);
+        return true;
+#else
+        (void)width;
+        (void)height;
+        std::cout << "ERROR::HEADLESS::BUILT_WITHOUT_EGL" << std::endl;
+        return false;
+#endif
+    }
+
+    // GL function loader of the context, for what else wants to look up entry points
+    static GLADapiproc getProcAddress(const char* name)
+    {
+#ifdef HAVE_EGL
+        return (GLADapiproc)eglGetProcAddress(name);
+#else
+        (void)name;
+        return nullptr;
+#endif
+    }
+
+    void release()
+    {
+#ifdef HAVE_EGL
+        if (context != EGL_NO_CONTEXT)
+        {
+            glDeleteFramebuffers(1, &FBO);
+            glDeleteRenderbuffers(2, renderbuffers);
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+            context = EGL_NO_CONTEXT;
+        }
+        if (display != EGL_NO_DISPLAY) eglTerminate(display);
+        display = EGL_NO_DISPLAY;
+#endif
+        FBO = 0;
+    }
+
+private:
+    unsigned int renderbuffers[2] = { 0, 0 };
+#ifdef HAVE_EGL
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    // the surfaceless platform if the EGL library has it, then the first device, then whatever the default is
+    static EGLDisplay openDisplay()
+    {
+        const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (extensions && getPlatformDisplay)
+        {
+            if (std::strstr(extensions, "EGL_MESA_platform_surfaceless"))
+            {
+                EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+                if (display != EGL_NO_DISPLAY) return display;
+            }
+            auto queryDevices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+            EGLDeviceEXT device;
+            EGLint devices = 0;
+            if (std::strstr(extensions, "EGL_EXT_platform_device") && queryDevices && queryDevices(1, &device, &devices) && devices > 0)
+            {
+                EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, device, NULL);
+                if (display != EGL_NO_DISPLAY) return display;
+            }
+        }
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+#endif
+};
+#endif
@@ -1,16 +1,38 @@
 #include <glad/gl.h>
 #include <GLFW/glfw3.h>
-#include <stb_image.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "gl_state.h"
 #include "shader.h"
+#include "program_cache.h"
+#include "shader_reloader.h"
+#include "texture_loader.h"
 #include "camera.h"
 #include "map.h"
-
+#include "uniform_blocks.h"
+#include "wall_instances.h"
+#include "wall_chunks.h"
+#include "render_queue.h"
+#include "stream_buffer.h"
+#include "cube_batch.h"
+#include "frustum.h"
+#include "pvs.h"
+#include "occlusion.h"
+#include "gpu_culling.h"
+#include "clustered_lights.h"
+#include "deferred.h"
+#include "headless.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <string>
 
 struct AABB {
     glm::vec3 min;
@@ -23,14 +45,16 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void processInput(GLFWwindow *window);
 
-unsigned int loadTexture(const char *path);
 
 void updatePhysics(float deltaTime);
 bool AABBIntersect(const AABB& box1, const AABB& box2);
 AABB GenerateBoindingBox(glm::vec3 position, float w, float h, float d);
 bool checkCollision();
 
-void setLights(Shader& shader);
+void createLights();
+void setLights(LightBlock& lights);
+void showFrameStats(GLFWwindow* window, float currentFrame);
+DrawPacket cubePacket(Shader& shader, unsigned int material, unsigned int VAO, glm::vec3 position, float scale);
 
 // settings
 const unsigned int SCR_WIDTH = 1200;
@@ -44,6 +68,32 @@ float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 bool cameraFixed = true;
 
+// wall rendering paths, cycled with M
+enum WallPath {
+    WALLS_INSTANCED,
+    WALLS_CHUNKS,
+    // instanced, with the walls in view picked on the GPU through transform feedback
+    WALLS_GPU_CULLED,
+    WALL_PATH_COUNT
+};
+WallPath wallPath = WALLS_CHUNKS;
+// view frustum culling of wall chunks and cells, toggled with C
+bool cullingEnabled = true;
+// potentially visible set culling while the camera is inside the maze, toggled with P
+bool pvsEnabled = true;
+const char* PVS_PATH = "res/labyrinth.pvs";
+// linked programs, reused across runs while the shaders and the driver stay the same
+const char* SHADER_CACHE_DIRECTORY = "res/shader_cache";
+// textures with their mipmaps in GPU formats, written by the texture_cook build step
+const char* COOKED_TEXTURE_DIRECTORY = "res/cooked";
+// width and height of every layer of the material texture array, the size of the largest square material
+// (container2 is 500x500, player_diffuse 512x512). The 1280x854 floor is the one scaled down and squashed
+const int MATERIAL_LAYER_SIZE = 512;
+// bytes of per-frame data (instances, uniform blocks) each frame in flight starts with, grows when a frame needs more
+const size_t STREAM_BUFFER_FRAME_SIZE = 1 << 20;
+// hardware occlusion queries on wall chunks, for maps without a pvs, cycled with O
+OcclusionMode occlusionMode = OCCLUSION_OFF;
+
 // game
 glm::vec3 startPos(1.5f, 0.5f, 5.5f);
 glm::vec3 endPos(13.5f, 0.5f, 13.5f);
@@ -59,71 +109,153 @@ const float PLAYER_SIDE = 0.6f;
 float deltaTime = 0.0f; 
 float lastFrame = 0.0f;
 
+// frame stats shown in the window title
+float statsStart = 0.0f;
+unsigned int statsFrames = 0;
+unsigned int cellsCulled = 0;
+unsigned int chunksOccluded = 0;
+
 // lighting
 glm::vec3 lightPos(7.5f, 20.0f, 7.5f);
 
 // lights
-glm::vec3 pointLightPositions[] = {
+glm::vec3 cornerLightPositions[] = {
     glm::vec3( 1.5f, 2.0f,  1.5f),
     glm::vec3( 1.5f, 2.0f,  13.5f),
     glm::vec3(13.5f, 2.0f,  1.5f),
     glm::vec3(13.5f, 2.0f,  13.5f)
 };
-
-int main()
+// every point light, binned into clusters each frame so their number is not limited by the shaders
+std::vector<PointLight> pointLights;
+// small lights along the corridors, toggled with L
+bool corridorLights = false;
+
+// deferred shading instead of clustered forward shading, picked at startup with --deferred
+bool deferredShading = false;
+// renders offscreen into a framebuffer without a window or display, for benchmarks, --headless
+bool headless = false;
+// frames rendered before exiting and printing the average frame time, --frames N. 0 runs until the window closes
+unsigned int frameLimit = 0;
+const unsigned int HEADLESS_FRAMES = 1000;
+// size of the window or of the headless framebuffer, --size WxH
+unsigned int renderWidth = SCR_WIDTH;
+unsigned int renderHeight = SCR_HEIGHT;
+
+int main(int argc, char** argv)
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--deferred") deferredShading = true;
+        else if (argument == "--headless") headless = true;
+        else if (argument == "--frames" && i + 1 < argc) frameLimit = (unsigned int)std::max(0, std::atoi(argv[++i]));
+        else if (argument == "--size" && i + 1 < argc)
+        {
+            if (std::sscanf(argv[++i], "%ux%u", &renderWidth, &renderHeight) != 2 || renderWidth == 0 || renderHeight == 0)
+            {
+                std::cout << "ERROR::ARGUMENTS::BAD_SIZE: " << argv[i] << ", expected <width>x<height>" << std::endl;
+                return -1;
+            }
+        }
+    }
+    if (headless && frameLimit == 0) frameLimit = HEADLESS_FRAMES;
 
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Renderer", NULL, NULL);
-    if (window == NULL)
+    GLFWwindow* window = NULL;
+    HeadlessContext headlessContext;
+    GLADloadfunc loadGL = glfwGetProcAddress;
+    if (headless)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        // no glfw at all, it needs a display. Frames go to the context's framebuffer, which stays bound
+        if (!headlessContext.create((int)renderWidth, (int)renderHeight))
+        {
+            headlessContext.release();
+            return -1;
+        }
+        loadGL = HeadlessContext::getProcAddress;
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetKeyCallback(window, key_callback);
-
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGL(glfwGetProcAddress)) 
+    else
     {
-        std::cout << "Failed to initialize GLAD\n";
-        glfwTerminate();
-        return -1;
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(renderWidth, renderHeight, "Renderer", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetKeyCallback(window, key_callback);
+
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        // glad: load all OpenGL function pointers
+        // ---------------------------------------
+        if (!gladLoadGL(glfwGetProcAddress)) 
+        {
+            std::cout << "Failed to initialize GLAD\n";
+            glfwTerminate();
+            return -1;
+        }
     }
 
     // configure global opengl state
     glEnable(GL_DEPTH_TEST);
+    auto startupStart = std::chrono::steady_clock::now();
+
+    // build and compile our shaders program, programs linked by an earlier run are loaded from the binary cache
+    Shader::enableBinaryCache(SHADER_CACHE_DIRECTORY);
+    Shader::enableParallelCompile(loadGL);
+    Shader::bindUniformBlock("FrameBlock", FRAME_BLOCK_BINDING);
+    Shader::bindUniformBlock("LightBlock", LIGHT_BLOCK_BINDING);
+    // every program variant is compiled once, keyed by its sources and defines. They are only submitted
+    // here and compile while the buffers and textures are set up, nothing waits for them until finish
+    ProgramCache programs;
+    // lit surfaces are shaded forward or written to the G-buffer, walls and player read a specular map
+    // while the floor has a constant specular color. Walls and floor are built in world space and use
+    // the variant without a model matrix, the player is only moved and scaled
+    const char* litFragment = deferredShading ? "res/shaders/gbuffer.fs" : "res/shaders/forward.fs";
+    Shader& shader = programs.submit("res/shaders/wall.vs", litFragment, { "SPECULAR_MAP", "IDENTITY_TRANSFORM" });
+    Shader& playerShader = programs.submit("res/shaders/wall.vs", litFragment, { "SPECULAR_MAP" });
+    Shader& lightShader = programs.submit("res/shaders/light.vs", "res/shaders/light.fs");
+    // light cubes and markers, one instanced draw for all of them
+    Shader& cubeShader = programs.submit("res/shaders/light.vs", "res/shaders/light.fs", { "INSTANCED" });
+    Shader& floorShader = programs.submit("res/shaders/floor.vs", litFragment, { "IDENTITY_TRANSFORM" });
+    // picks the walls in view for the GPU culled wall path
+    Shader& cullShader = programs.submitFeedback("res/shaders/cull.vs", "res/shaders/cull.gs", { "InstanceOffset" });
+    // lighting passes of the deferred path, only built when it renders
+    Shader* deferredGlobalShader = nullptr;
+    Shader* deferredVolumeShader = nullptr;
+    if (deferredShading)
+    {
+        deferredGlobalShader = &programs.submit("res/shaders/deferred.vs", "res/shaders/deferred_global.fs");
+        deferredVolumeShader = &programs.submit("res/shaders/light_volume.vs", "res/shaders/light_volume.fs");
+    }
 
-    // build and compile our shaders program
-    Shader shader("res/shaders/wall.vs", "res/shaders/wall.fs");
-    Shader lightShader("res/shaders/light.vs", "res/shaders/light.fs");
-    Shader floorShader("res/shaders/floor.vs", "res/shaders/floor.fs");
+    // everything rewritten every frame goes through this ring, so uploads never wait for the GPU
+    StreamBuffer streamBuffer(STREAM_BUFFER_FRAME_SIZE);
 
     unsigned int wallVBO, wallVAO;
     glGenVertexArrays(1, &wallVAO);
     glGenBuffers(1, &wallVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, wallVBO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, wallVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
-    glBindVertexArray(wallVAO);
+    glState.bindVertexArray(wallVAO);
     // position attribute
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
@@ -134,20 +266,46 @@ int main()
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
     glEnableVertexAttribArray(2);
 
+    // walls read their position from the instance buffer, rebuilt only when the labyrinth changes
+    WallInstances wallInstances(streamBuffer);
+    wallInstances.attach(wallVAO);
+    wallInstances.update();
+
+    // same walls and instance layout, culled by a transform feedback pass instead of on the CPU
+    GpuWallCulling gpuCulling(cullShader, wallVBO);
+    gpuCulling.update();
+
+    // walls merged into one mesh per chunk with the hidden faces removed, edited chunks are remeshed in the background
+    WallChunks wallChunks;
+    wallChunks.build();
+    cellChangedCallback = [&wallChunks](int row, int col) { wallChunks.markCell(row, col); };
+
+    // the player shares the cube vertices but has no instance offset
+    unsigned int playerVAO;
+    glGenVertexArrays(1, &playerVAO);
+    glState.bindVertexArray(playerVAO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, wallVBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+
     unsigned int lightCubeVAO;
     glGenVertexArrays(1, &lightCubeVAO);
-    glBindVertexArray(lightCubeVAO);
+    glState.bindVertexArray(lightCubeVAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, wallVBO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, wallVBO);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
     unsigned floorVBO, floorVAO;
     glGenVertexArrays(1, &floorVAO);
     glGenBuffers(1, &floorVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, floorVBO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, floorVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(floorVertices), floorVertices, GL_STATIC_DRAW);
-    glBindVertexArray(floorVAO);
+    glState.bindVertexArray(floorVAO);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
     // normal attribute
@@ -157,30 +315,130 @@ int main()
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
     glEnableVertexAttribArray(2);
 
-    // load textures
-    unsigned int diffuseMap = loadTexture("res/textures/container2.png");
-    unsigned int specularMap = loadTexture("res/textures/container2_specular.png");
-    unsigned int diffuseMap_floor = loadTexture("res/textures/floor.jpg");
-    unsigned int diffuseMap_player = loadTexture("res/textures/player_diffuse.jpg");
-    unsigned int specularMap_player = loadTexture("res/textures/player_specular.jpg");
+    // load textures, read from their cooked files or decoded in the background and shown as flat
+    // gray (no highlights for the specular maps) until they are uploaded
+    TextureLoader textureLoader(COOKED_TEXTURE_DIRECTORY);
+    // every material is a layer of one array, resized to MATERIAL_LAYER_SIZE where it differs, with the
+    // specular map packed into the alpha of the diffuse texture
+    const int wallLayer = 0, floorLayer = 1, playerLayer = 2;
+    TextureArray materialTextures = textureLoader.createArray(MATERIAL_LAYER_SIZE, MATERIAL_LAYER_SIZE, 3, true);
+    textureLoader.loadLayer(materialTextures, wallLayer, "res/textures/container2.png", "res/textures/container2_specular.png");
+    textureLoader.loadLayer(materialTextures, floorLayer, "res/textures/floor.jpg");
+    textureLoader.loadLayer(materialTextures, playerLayer, "res/textures/player_diffuse.jpg", "res/textures/player_specular.jpg");
 
 
     // shader configuration
-    shader.use(); 
-    shader.setInt("material.diffuse", 0);   
-    shader.setInt("material.specular", 1);
+    programs.finish();
+    for (Shader* program : { &shader, &playerShader, &floorShader })
+    {
+        program->use();
+        program->setInt("materialTextures", MATERIAL_TEXTURE_UNIT);
+    }
+    // material properties, the texture layers are set by the render queue
+    for (Shader* program : { &shader, &playerShader })
+    {
+        program->use();
+        program->setFloat("material.shininess", 64.0f);
+    }
 
     floorShader.use();
-    floorShader.setInt("material.diffuse", 2);
+    floorShader.setVec3("material.specular", 0.5f, 0.5f, 0.5f);
+    floorShader.setFloat("material.shininess", 32.0f);
+
+    // every draw goes through the render queue, sorted to keep state changes down
+    RenderQueue renderQueue;
+    unsigned int wallMaterial = renderQueue.addMaterial(Material{ wallLayer });
+    unsigned int playerMaterial = renderQueue.addMaterial(Material{ playerLayer });
+    unsigned int floorMaterial = renderQueue.addMaterial(Material{ floorLayer });
+    // what the cached wall packets were built from
+    int wallPacketsPath = -1;
+    unsigned int wallPacketsRevision = 0;
+    unsigned int wallPacketsMapRevision = 0;
+    // chunk drawn by each static wall packet
+    std::vector<int> wallPacketChunks;
+
+    Frustum frustum;
+
+    // chunk boxes are drawn with the flat light program, only their depth test matters
+    ChunkOcclusion occlusion(lightShader, lightCubeVAO);
+    // flat colored cubes recorded during the frame, drawn after the lit surfaces
+    CubeBatch cubes(cubeShader, streamBuffer, wallVBO);
+    // chunks that survived frustum and pvs culling, handed to the occlusion pass
+    std::vector<int> occlusionCandidates;
+
+    // walls visible from each open cell, precomputed once and cached on disk next to the resources
+    PotentiallyVisibleSet pvs;
+    if (!pvs.load(PVS_PATH))
+    {
+        auto pvsStart = std::chrono::steady_clock::now();
+        pvs.build();
+        pvs.save(PVS_PATH);
+        std::cout << "PVS built in " << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - pvsStart).count() << " ms" << std::endl;
+    }
+
+    // point lights reach the fragment shaders through texture buffers, binned per view cluster
+    createLights();
+    LightClusters lightClusters;
+    for (Shader* program : { &shader, &playerShader, &floorShader })
+    {
+        program->use();
+        program->setInt("lightData", LIGHT_DATA_TEXTURE_UNIT);
+        program->setInt("lightClusters", LIGHT_CLUSTERS_TEXTURE_UNIT);
+        program->setInt("lightIndices", LIGHT_INDICES_TEXTURE_UNIT);
+    }
+
+    // camera and lights are shared by every program through uniform buffers
+    UniformBuffer<FrameBlock> frameUniforms(streamBuffer, FRAME_BLOCK_BINDING);
+    UniformBuffer<LightBlock> lightUniforms(streamBuffer, LIGHT_BLOCK_BINDING);
+
+    // G-buffer and light passes, only with --deferred
+    std::unique_ptr<DeferredRenderer> deferred;
+    if (deferredShading) deferred = std::make_unique<DeferredRenderer>(*deferredGlobalShader, *deferredVolumeShader);
+
+    // one throwaway draw per program, so the driver does its lazy compiles now and not in the first frame.
+    // the first frame clears what they drew
+    shader.prewarm(wallVAO);
+    playerShader.prewarm(playerVAO);
+    floorShader.prewarm(floorVAO);
+    lightShader.prewarm(lightCubeVAO);
+    cubeShader.prewarm(lightCubeVAO);
+    if (deferred) deferred->prewarm(lightCubeVAO);
+
+    // saving a shader or one of its includes rebuilds the programs using it while the app runs
+    ShaderReloader shaderReloader;
+    shaderReloader.watch(shader);
+    shaderReloader.watch(playerShader);
+    shaderReloader.watch(floorShader);
+    shaderReloader.watch(lightShader);
+    shaderReloader.watch(cubeShader);
+    if (deferred) deferred->watchShaders(shaderReloader);
+
+    std::cout << "Startup took " << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startupStart).count() << " ms, "
+              << Shader::ProgramsLinked << " programs linked, " << Shader::BinariesLoaded << " loaded from the binary cache" << std::endl;
 
     // render loop
-    while (!glfwWindowShouldClose(window))
+    unsigned int framesRendered = 0;
+    auto loopStart = std::chrono::steady_clock::now();
+    while (headless || !glfwWindowShouldClose(window))
     {
-        float currentFrame = static_cast<float>(glfwGetTime());
+        if (frameLimit > 0 && framesRendered == frameLimit) break;
+        float currentFrame = headless ? std::chrono::duration<float>(std::chrono::steady_clock::now() - loopStart).count()
+                                      : static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        processInput(window);
+        glState.beginFrame();
+        streamBuffer.beginFrame();
+        // reloaded programs are only swapped in between frames
+        shaderReloader.update();
+        if (textureLoader.Pending > 0)
+        {
+            textureLoader.update();
+            if (textureLoader.Pending == 0)
+                std::cout << "Textures resident " << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startupStart).count() << " ms after startup" << std::endl;
+        }
+
+        if (window) processInput(window);
 
         if (gravityActive) 
         {
@@ -195,124 +453,211 @@ int main()
         }
 
         // render
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        shader.use();
+        if (deferredShading)
+        {
+            int framebufferWidth = headlessContext.Width, framebufferHeight = headlessContext.Height;
+            if (window) glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            deferred->beginGeometry(framebufferWidth, framebufferHeight);
+        }
+        else
+        {
+            glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+        // the one texture binding every lit draw needs
+        glState.bindTexture(MATERIAL_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, materialTextures.ID);
 
-        setLights(shader);
+        // view/projection transformations
+        FrameBlock frame = {};
+        frame.projection = glm::perspective(glm::radians(camera.Zoom), (float)renderWidth / (float)renderHeight, 0.1f, 100.0f);
+        frame.view = camera.GetViewMatrix();
+        frame.viewPos = camera.Position;
+        frameUniforms.update(frame);
+
+        frustum.extract(frame.projection * frame.view);
+
+        lightClusters.update(pointLights, frame.view, frame.projection, 0.1f, 100.0f);
+        lightClusters.bind();
+
+        LightBlock lights = {};
+        setLights(lights);
+        lightClusters.fill(lights);
+        lightUniforms.update(lights);
+
+        // chunk walls are static packets, only resubmitted when a chunk got remeshed or the path changed
+        wallChunks.update();
+        wallInstances.update();
+        if (wallPacketsPath != wallPath || wallPacketsRevision != wallChunks.Revision || wallPacketsMapRevision != mapRevision)
+        {
+            renderQueue.clearStatic();
+            wallPacketChunks.clear();
+            if (wallPath == WALLS_CHUNKS)
+            {
+                // one draw per chunk of merged wall faces
+                for (int i = 0; i < (int)wallChunks.Chunks.size(); i++)
+                {
+                    const WallChunk& chunk = wallChunks.Chunks[i];
+                    if (chunk.VertexCount == 0) continue;
+                    DrawPacket wall = {};
+                    wall.shader = &shader;
+                    wall.material = wallMaterial;
+                    wall.VAO = chunk.VAO;
+                    wall.mode = GL_TRIANGLES;
+                    wall.count = chunk.VertexCount;
+                    wall.model = glm::mat4(1.0f);
+                    wall.center = (chunk.boundsMin + chunk.boundsMax) * 0.5f;
+                    renderQueue.submitStatic(wall);
+                    wallPacketChunks.push_back(i);
+                }
+            }
+            wallPacketsPath = wallPath;
+            wallPacketsRevision = wallChunks.Revision;
+            wallPacketsMapRevision = mapRevision;
+        }
 
-        // material properties
-        shader.setVec3("material.specular", 0.8f, 0.8f, 0.8f);
-        shader.setFloat("material.shininess", 64.0f);
+        // the pvs only holds while the camera is in an open cell below the top of the walls,
+        // and it goes stale when the map is edited
+        int viewCell = -1;
+        if (cullingEnabled && pvsEnabled && pvs.current() && camera.Position.y < BLOCK_SIDE)
+            viewCell = pvs.cellAt(camera.Position);
 
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
-
-        // bind diffuse map
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap);
-        // bind specular map
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMap);
-
-        glBindVertexArray(wallVAO);
-
-        glm::mat4 model;
-
-        for (int i=0; i<MAP_ROWS; i++) {
-            for (int j=0; j<MAP_COLS; j++) {
-                if (labyrinth[i][j] == 0) continue;
-                model = glm::mat4(1.0f);
-                glm::vec3 position;
-                position.x = j + BLOCK_SIDE / 2;
-                position.y = BLOCK_SIDE / 2;
-                position.z = i + BLOCK_SIDE / 2;
-                model = glm::translate(model, position);
-                shader.setMat4("model", model);
-                glDrawArrays(GL_TRIANGLES, 0, 36);
+        cellsCulled = 0;
+        chunksOccluded = 0;
+        occlusionCandidates.clear();
+        if (wallPath == WALLS_CHUNKS)
+        {
+            for (unsigned int i = 0; i < renderQueue.staticCount(); i++)
+            {
+                const WallChunk& chunk = wallChunks.Chunks[wallPacketChunks[i]];
+                bool hidden = cullingEnabled && !frustum.visible(chunk.boundsMin, chunk.boundsMax);
+                if (viewCell >= 0 && !pvs.anyVisible(viewCell, chunk.row, chunk.row + CHUNK_SIZE, chunk.col, chunk.col + CHUNK_SIZE))
+                    hidden = true;
+                if (hidden) cellsCulled += chunk.WallCount;
+                else if (occlusionMode != OCCLUSION_OFF) occlusionCandidates.push_back(wallPacketChunks[i]);
+                // chunks under occlusion queries are drawn by the occlusion pass instead of the queue
+                renderQueue.setStaticHidden(i, hidden || occlusionMode != OCCLUSION_OFF);
             }
         }
-        //
-        // bind diffuse map
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap_player);
-        // bind specular map
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMap_player);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, playerPos);
-        model = glm::scale(model, glm::vec3(0.6f));
-        lightShader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        floorShader.use();
-        setLights(floorShader);
-
-        floorShader.setVec3("material.specular", 0.5f, 0.5f, 0.5f);
-        floorShader.setFloat("material.shininess", 32.0f);
-
-
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap_floor);
-
-        floorShader.setMat4("projection", projection);
-        floorShader.setMat4("view", view);
-        model = glm::mat4(1.0f);
-        floorShader.setMat4("model", model);
-
-        glBindVertexArray(floorVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        lightShader.use();
-        lightShader.setMat4("projection", projection);
-        lightShader.setMat4("view", view);
-
-        glBindVertexArray(lightCubeVAO);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, lightPos);
-        model = glm::scale(model, glm::vec3(0.4f));
-        lightShader.setVec3("CubeColor", glm::vec3(1.0f, 1.0f, 1.0f));
-        lightShader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        for (unsigned int i = 0; i < 4; i++)
+        else if (wallPath == WALLS_GPU_CULLED && cullingEnabled)
         {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, pointLightPositions[i]);
-            model = glm::scale(model, glm::vec3(0.2f)); // Make it a smaller cube
-            lightShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            // draws the walls found in view by an earlier frame's pass, the count is never waited for
+            gpuCulling.update();
+            gpuCulling.cull(frustum);
+            cellsCulled = gpuCulling.Total - gpuCulling.Count;
+
+            DrawPacket wall = {};
+            wall.shader = &shader;
+            wall.material = wallMaterial;
+            wall.VAO = gpuCulling.VAO();
+            wall.mode = GL_TRIANGLES;
+            wall.count = 36;
+            wall.instances = gpuCulling.Count;
+            wall.model = glm::mat4(1.0f);
+            wall.center = glm::vec3((float)MAP_COLS / 2, 0.5f, (float)MAP_ROWS / 2);
+            wall.hidden = gpuCulling.Count == 0;
+            renderQueue.submit(wall);
         }
+        else
+        {
+            // all walls in one instanced draw, only the ones in view when culling
+            if (cullingEnabled)
+                cellsCulled = wallInstances.cull(frustum, &pvs, viewCell);
+            else
+                wallInstances.uploadAll();
+
+            DrawPacket wall = {};
+            wall.shader = &shader;
+            wall.material = wallMaterial;
+            wall.VAO = wallVAO;
+            wall.mode = GL_TRIANGLES;
+            wall.count = 36;
+            wall.instances = wallInstances.Count;
+            wall.model = glm::mat4(1.0f);
+            wall.center = glm::vec3((float)MAP_COLS / 2, 0.5f, (float)MAP_ROWS / 2);
+            wall.hidden = wallInstances.Count == 0;
+            renderQueue.submit(wall);
+        }
+
+        // player
+        DrawPacket player = cubePacket(playerShader, playerMaterial, playerVAO, playerPos, 0.6f);
+        renderQueue.submit(player);
+
+        // floor
+        DrawPacket floor = {};
+        floor.shader = &floorShader;
+        floor.material = floorMaterial;
+        floor.VAO = floorVAO;
+        floor.mode = GL_TRIANGLES;
+        floor.count = 6;
+        floor.model = glm::mat4(1.0f);
+        floor.center = glm::vec3((float)MAP_COLS / 2, 0.0f, (float)MAP_ROWS / 2);
+        renderQueue.submit(floor);
+
+        // walls go first and front to back so every chunk box is tested against the chunks in front of it
+        if (wallPath == WALLS_CHUNKS && occlusionMode != OCCLUSION_OFF)
+        {
+            occlusion.render(occlusionMode, wallChunks.Chunks, occlusionCandidates, camera.Position, [&](const WallChunk& chunk) {
+                shader.use();
+                shader.setInt("material.layer", wallLayer);
+                glState.bindVertexArray(chunk.VAO);
+                glDrawArrays(GL_TRIANGLES, 0, chunk.VertexCount);
+            });
+            chunksOccluded = occlusion.Occluded;
+        }
+        else occlusion.skipFrame();
+
+        renderQueue.flush(camera.Position, 100.0f);
 
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, startPos);
-        model = glm::scale(model, glm::vec3(0.2f));
-        lightShader.setVec3("CubeColor", glm::vec3(0.0f, 1.0f, 0.0f));
-        lightShader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        // the deferred path lights the G-buffer here, the flat colored cubes below are drawn forward over it
+        if (deferredShading)
+            deferred->light(frame.projection * frame.view, lightCubeVAO, (int)pointLights.size(), headlessContext.FBO);
 
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, endPos);
-        model = glm::scale(model, glm::vec3(0.2f));
-        lightShader.setVec3("CubeColor", glm::vec3(1.0f, 0.0f, 0.0f));
-        lightShader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        // light cubes and start/end markers
+        cubes.drawCube(lightPos, 0.4f, glm::vec3(1.0f, 1.0f, 1.0f));
+        for (const PointLight& pointLight : pointLights)
+            cubes.drawCube(pointLight.position, 0.2f, glm::vec3(1.0f, 1.0f, 1.0f)); // Make it a smaller cube
+        cubes.drawCube(startPos, 0.2f, glm::vec3(0.0f, 1.0f, 0.0f));
+        cubes.drawCube(endPos, 0.2f, glm::vec3(1.0f, 0.0f, 0.0f));
+        cubes.flush();
 
+        showFrameStats(window, currentFrame);
+        framesRendered++;
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (window)
+        {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+    }
+
+    if (frameLimit > 0)
+    {
+        // the last frames are still queued, wait for them so their GPU time is counted
+        glFinish();
+        float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - loopStart).count();
+        std::cout << "Rendered " << framesRendered << " frames at " << renderWidth << "x" << renderHeight << " in " << seconds << " s: "
+                  << 1000.0f * seconds / std::max(framesRendered, 1u) << " ms per frame, " << framesRendered / seconds << " fps" << std::endl;
     }
 
+    glState.invalidate();
     glDeleteVertexArrays(1, &wallVAO);
+    glDeleteVertexArrays(1, &playerVAO);
     glDeleteVertexArrays(1, &lightCubeVAO);
     glDeleteBuffers(1, &wallVBO);
-
-    glfwTerminate();
+    wallInstances.release();
+    gpuCulling.release();
+    occlusion.release();
+    cubes.release();
+    lightClusters.release();
+    if (deferred) deferred->release();
+    shaderReloader.release();
+    textureLoader.release();
+    cellChangedCallback = nullptr;
+    wallChunks.release();
+    streamBuffer.release();
+
+    if (headless) headlessContext.release();
+    else glfwTerminate();
     return 0;
 }
 
@@ -433,43 +778,22 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     if (key == GLFW_KEY_G && action == GLFW_PRESS) {
         gravityActive = !gravityActive;
     }
-}
-
-unsigned int loadTexture(char const * path)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
+    if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+        wallPath = (WallPath)((wallPath + 1) % WALL_PATH_COUNT);
     }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        cullingEnabled = !cullingEnabled;
+    }
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        pvsEnabled = !pvsEnabled;
+    }
+    if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+        corridorLights = !corridorLights;
+        createLights();
+    }
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        occlusionMode = (OcclusionMode)((occlusionMode + 1) % OCCLUSION_MODE_COUNT);
     }
-
-    return textureID;
 }
 
 void updatePhysics(float deltaTime)
@@ -512,55 +836,86 @@ bool checkCollision() {
     return false;
 }
 
-void setLights(Shader& shader) {
-    shader.setVec3("light.direction", 7.5, -1.0, 7.5f);
-    shader.setVec3("viewPos", camera.Position);
+// fills pointLights: the four corner lights, plus a dim light over every third open cell with corridorLights
+void createLights() {
+    pointLights.clear();
+    for (const glm::vec3& position : cornerLightPositions)
+    {
+        PointLight light = {};
+        light.position = position;
+        light.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+        light.diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+        light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+        light.constant = 1.0f;
+        light.linear = 0.09f;
+        light.quadratic = 0.032f;
+        light.radius = pointLightRadius(light);
+        pointLights.push_back(light);
+    }
+    if (!corridorLights) return;
+
+    for (int z = 0; z < MAP_ROWS; z++) {
+        for (int x = 0; x < MAP_COLS; x++) {
+            if (labyrinth[z][x] != 0 || (x + z) % 3 != 0) continue;
+            PointLight light = {};
+            light.position = glm::vec3(x + 0.5f, 0.8f, z + 0.5f);
+            light.ambient = glm::vec3(0.02f, 0.01f, 0.0f);
+            light.diffuse = glm::vec3(0.6f, 0.35f, 0.15f);
+            light.specular = glm::vec3(0.6f, 0.35f, 0.15f);
+            light.constant = 1.0f;
+            light.linear = 0.7f;
+            light.quadratic = 1.8f;
+            light.radius = pointLightRadius(light);
+            pointLights.push_back(light);
+        }
+    }
+}
+
+void setLights(LightBlock& lights) {
+    // the directional light was never wired up (it used to be written as light.* while the shaders read
+    // dirLight), so it stays off until it gets tuned
+    lights.dirLight.direction = glm::vec3(7.5f, -1.0f, 7.5f);
 
-    shader.setVec3("light.ambient", 0.2f, 0.2f, 0.2f); 
-    shader.setVec3("light.diffuse", 0.8f, 0.8f, 8.6f);
-    shader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-    
-    // point light 1
-    shader.setVec3("pointLights[0].position", pointLightPositions[0]);
-    shader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-    shader.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-    shader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-    shader.setFloat("pointLights[0].constant", 1.0f);
-    shader.setFloat("pointLights[0].linear", 0.09f);
-    shader.setFloat("pointLights[0].quadratic", 0.032f);
-    // point light 2
-    shader.setVec3("pointLights[1].position", pointLightPositions[1]);
-    shader.setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-    shader.setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-    shader.setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-    shader.setFloat("pointLights[1].constant", 1.0f);
-    shader.setFloat("pointLights[1].linear", 0.09f);
-    shader.setFloat("pointLights[1].quadratic", 0.032f);
-    // point light 3
-    shader.setVec3("pointLights[2].position", pointLightPositions[2]);
-    shader.setVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-    shader.setVec3("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-    shader.setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-    shader.setFloat("pointLights[2].constant", 1.0f);
-    shader.setFloat("pointLights[2].linear", 0.09f);
-    shader.setFloat("pointLights[2].quadratic", 0.032f);
-    // point light 4
-    shader.setVec3("pointLights[3].position", pointLightPositions[3]);
-    shader.setVec3("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-    shader.setVec3("pointLights[3].diffuse", 0.8f, 0.8f, 0.8f);
-    shader.setVec3("pointLights[3].specular", 1.0f, 1.0f, 1.0f);
-    shader.setFloat("pointLights[3].constant", 1.0f);
-    shader.setFloat("pointLights[3].linear", 0.09f);
-    shader.setFloat("pointLights[3].quadratic", 0.032f);
     // spotLight
-    shader.setVec3("spotLight.position", camera.Position);
-    shader.setVec3("spotLight.direction", camera.Front);
-    shader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-    shader.setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-    shader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-    shader.setFloat("spotLight.constant", 1.0f);
-    shader.setFloat("spotLight.linear", 0.09f);
-    shader.setFloat("spotLight.quadratic", 0.032f);
-    shader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-    shader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));   
+    lights.spotLight.position = camera.Position;
+    lights.spotLight.direction = camera.Front;
+    lights.spotLight.ambient = glm::vec3(0.0f, 0.0f, 0.0f);
+    lights.spotLight.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+    lights.spotLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    lights.spotLight.constant = 1.0f;
+    lights.spotLight.linear = 0.09f;
+    lights.spotLight.quadratic = 0.032f;
+    lights.spotLight.cutOff = glm::cos(glm::radians(12.5f));
+    lights.spotLight.outerCutOff = glm::cos(glm::radians(15.0f));
+}
+
+// puts the frame rate and the GL binds issued/elided by glState in the window title, or on stdout when headless, once per second
+void showFrameStats(GLFWwindow* window, float currentFrame)
+{
+    statsFrames++;
+    if (currentFrame - statsStart < 1.0f) return;
+
+    char title[256];
+    snprintf(title, sizeof(title), "Renderer | %.0f fps | binds issued %u, elided %u | walls culled %u | chunks occluded %u",
+             statsFrames / (currentFrame - statsStart), glState.Frame.issued, glState.Frame.elided, cellsCulled, chunksOccluded);
+    // headless runs have no title to put it in
+    if (window) glfwSetWindowTitle(window, title);
+    else std::cout << title << std::endl;
+
+    statsStart = currentFrame;
+    statsFrames = 0;
+}
+
+// a cube of the given size centered at position
+DrawPacket cubePacket(Shader& shader, unsigned int material, unsigned int VAO, glm::vec3 position, float scale)
+{
+    DrawPacket packet = {};
+    packet.shader = &shader;
+    packet.material = material;
+    packet.VAO = VAO;
+    packet.mode = GL_TRIANGLES;
+    packet.count = 36;
+    packet.model = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(scale));
+    packet.center = position;
+    return packet;
 }
@@ -0,0 +1,100 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#include <vector>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A whole file mapped read only into memory, pages are read by the OS as they are touched.
+// Where mmap is not available the file is read into memory instead.
+class MappedFile
+{
+public:
+    const unsigned char* Data;
+    size_t Size;
+
+    MappedFile() : Data(nullptr), Size(0)
+    {
+    }
+
+    MappedFile(MappedFile&& other) noexcept : Data(nullptr), Size(0)
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this == &other) return *this;
+        close();
+        Data = other.Data;
+        Size = other.Size;
+#ifdef _WIN32
+        contents.swap(other.contents);
+#endif
+        other.Data = nullptr;
+        other.Size = 0;
+        return *this;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        Data = contents.data();
+        Size = contents.size();
+        return Size > 0;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        void* mapping = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+            mapping = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping stays valid without the descriptor
+        ::close(fd);
+        if (mapping == MAP_FAILED) return false;
+        Data = (const unsigned char*)mapping;
+        Size = (size_t)info.st_size;
+        return true;
+#endif
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        contents.clear();
+#else
+        if (Data) munmap((void*)Data, Size);
+#endif
+        Data = nullptr;
+        Size = 0;
+    }
+
+private:
+#ifdef _WIN32
+    std::vector<unsigned char> contents;
+#endif
+};
+#endif
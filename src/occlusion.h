@@ -0,0 +1,190 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gl_state.h"
+#include "shader.h"
+#include "wall_chunks.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+enum OcclusionMode {
+    // chunks are drawn without occlusion queries
+    OCCLUSION_OFF,
+    // every chunk's box is queried right before the chunk, which is drawn under conditional rendering.
+    // the GPU waits for each query, the CPU never does.
+    OCCLUSION_CONDITIONAL,
+    // chunks are drawn if their box was visible last frame, boxes are queried again after the walls
+    // and read back once available, so neither the CPU nor the GPU ever waits
+    OCCLUSION_TEMPORAL,
+    OCCLUSION_MODE_COUNT
+};
+
+// Occlusion culling of wall chunks with GL_ANY_SAMPLES_PASSED queries against their bounding boxes.
+// Boxes are drawn with a flat program and a unit cube, without writing color or depth.
+class ChunkOcclusion
+{
+public:
+    // chunks skipped because their box was hidden last frame (temporal mode only)
+    unsigned int Occluded;
+
+    ChunkOcclusion(Shader& boxShader, unsigned int cubeVAO) : Occluded(0), boxShader(boxShader), cubeVAO(cubeVAO), frame(0)
+    {
+    }
+
+    // draws the given chunks front to back, drawChunk issues the actual draw of one chunk
+    template<typename DrawChunk>
+    void render(OcclusionMode mode, const std::vector<WallChunk>& chunks, const std::vector<int>& candidates, const glm::vec3& eye, DrawChunk drawChunk)
+    {
+        resize(chunks.size());
+        Occluded = 0;
+        frame++;
+
+        order.assign(candidates.begin(), candidates.end());
+        std::sort(order.begin(), order.end(), [&](int a, int b) {
+            return distance(chunks[a], eye) < distance(chunks[b], eye);
+        });
+
+        if (mode == OCCLUSION_CONDITIONAL)
+        {
+            for (int index : order)
+            {
+                const WallChunk& chunk = chunks[index];
+                if (contains(chunk, eye)) { drawChunk(chunk); continue; }
+
+                queryBox(index, chunk);
+                glBeginConditionalRender(states[index].query, GL_QUERY_WAIT);
+                drawChunk(chunk);
+                glEndConditionalRender();
+                // the result is consumed by the conditional render, temporal mode must not read it
+                states[index].issued = false;
+            }
+            return;
+        }
+
+        // temporal: a chunk that was not queried last frame (outside the frustum, not in the PVS, or another
+        // mode was on) has no result that says anything about this view, it is drawn until a new one arrives
+        for (int index : order)
+        {
+            ChunkState& state = states[index];
+            if (state.lastCandidate + 1 != frame)
+            {
+                state.visible = true;
+                state.issued = false;
+            }
+            state.lastCandidate = frame;
+        }
+
+        // pick up the results that arrived, never wait for the others
+        for (int index : order)
+        {
+            ChunkState& state = states[index];
+            if (!state.issued) continue;
+            GLuint available = 0;
+            glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) continue;
+            GLuint passed = 0;
+            glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &passed);
+            state.visible = passed != 0;
+            state.issued = false;
+        }
+
+        for (int index : order)
+        {
+            const WallChunk& chunk = chunks[index];
+            if (states[index].visible || contains(chunk, eye)) drawChunk(chunk);
+            else Occluded++;
+        }
+
+        // query every box against the finished walls for the next frame
+        for (int index : order)
+        {
+            const WallChunk& chunk = chunks[index];
+            if (contains(chunk, eye)) { states[index].visible = true; continue; }
+            if (states[index].issued) continue;
+            queryBox(index, chunk);
+            states[index].issued = true;
+        }
+    }
+
+    // call on frames that do not render through the occlusion pass, so the results of before count as stale
+    void skipFrame()
+    {
+        frame++;
+    }
+
+    void release()
+    {
+        for (ChunkState& state : states) glDeleteQueries(1, &state.query);
+        states.clear();
+    }
+
+private:
+    struct ChunkState {
+        unsigned int query;
+        // a query is in flight and its result was not read yet
+        bool issued;
+        // box passed the depth test the last time it was queried
+        bool visible;
+        // last frame the chunk was a candidate in temporal mode
+        uint64_t lastCandidate;
+    };
+
+    // boxes are grown a little so they never z-fight with the walls they contain
+    static constexpr float BOX_MARGIN = 0.02f;
+
+    Shader& boxShader;
+    unsigned int cubeVAO;
+    std::vector<ChunkState> states;
+    std::vector<int> order;
+    // frames so far, rendered or skipped
+    uint64_t frame;
+
+    void resize(size_t count)
+    {
+        while (states.size() < count)
+        {
+            ChunkState state = { 0, false, true, 0 };
+            glGenQueries(1, &state.query);
+            states.push_back(state);
+        }
+    }
+
+    static float distance(const WallChunk& chunk, const glm::vec3& eye)
+    {
+        return glm::length((chunk.boundsMin + chunk.boundsMax) * 0.5f - eye);
+    }
+
+    // a box around the camera would be clipped by the near plane, such chunks are always drawn
+    static bool contains(const WallChunk& chunk, const glm::vec3& eye)
+    {
+        float margin = BOX_MARGIN + 0.1f;
+        return eye.x >= chunk.boundsMin.x - margin && eye.x <= chunk.boundsMax.x + margin &&
+               eye.y >= chunk.boundsMin.y - margin && eye.y <= chunk.boundsMax.y + margin &&
+               eye.z >= chunk.boundsMin.z - margin && eye.z <= chunk.boundsMax.z + margin;
+    }
+
+    void queryBox(int index, const WallChunk& chunk)
+    {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), (chunk.boundsMin + chunk.boundsMax) * 0.5f);
+        model = glm::scale(model, chunk.boundsMax - chunk.boundsMin + glm::vec3(2.0f * BOX_MARGIN));
+
+        boxShader.use();
+        boxShader.setMat4("model", model);
+        glState.bindVertexArray(cubeVAO);
+
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, states[index].query);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    }
+};
+#endif
@@ -0,0 +1,102 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include "shader.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Every variant of a program is compiled once: programs are keyed by their source files and their set
+// of defines, so asking twice for the same sources and defines (in any order) returns the same Shader.
+// Variants are specialized by the preprocessor at compile time rather than by branching in the shader.
+class ProgramCache
+{
+public:
+    // programs compiled so far, one per distinct key
+    unsigned int Compiled;
+    // requests answered with an already compiled program
+    unsigned int Reused;
+
+    ProgramCache() : Compiled(0), Reused(0)
+    {
+    }
+
+    // returns the program ready to use, compiling it now if this is the first request
+    Shader& get(const char* vertexPath, const char* fragmentPath, std::vector<std::string> defines = {})
+    {
+        Shader& shader = submit(vertexPath, fragmentPath, std::move(defines));
+        shader.finish();
+        return shader;
+    }
+
+    // starts compiling the program if this is the first request and returns it without waiting.
+    // Submit every program first and finish() them together, so the compiles overlap with each other
+    // and with whatever runs in between.
+    Shader& submit(const char* vertexPath, const char* fragmentPath, std::vector<std::string> defines = {})
+    {
+        std::string key = programKey(std::string(vertexPath) + '\n' + fragmentPath, defines);
+        return add(key, [&] { return std::make_unique<Shader>(vertexPath, fragmentPath, defines, COMPILE_DEFERRED); });
+    }
+
+    // the same for a transform feedback program, capturing feedbackVaryings
+    Shader& submitFeedback(const char* vertexPath, const char* geometryPath, const std::vector<const char*>& feedbackVaryings,
+                           std::vector<std::string> defines = {})
+    {
+        std::string stages = std::string(vertexPath) + '\n' + geometryPath;
+        for (const char* varying : feedbackVaryings)
+            stages += std::string("\nout ") + varying;
+        std::string key = programKey(stages, defines);
+        return add(key, [&] { return std::make_unique<Shader>(vertexPath, geometryPath, defines, feedbackVaryings, COMPILE_DEFERRED); });
+    }
+
+    // finishes every submitted program, those the driver already completed first
+    void finish()
+    {
+        while (!pending.empty())
+        {
+            auto done = std::find_if(pending.begin(), pending.end(), [](Shader* shader) { return shader->ready(); });
+            // nothing completed yet, waiting for the oldest one is as good as any
+            if (done == pending.end()) done = pending.begin();
+            (*done)->finish();
+            pending.erase(done);
+        }
+    }
+
+private:
+    // Shaders are held by pointer so references handed out stay valid as the map grows
+    std::unordered_map<std::string, std::unique_ptr<Shader>> programs;
+    // submitted programs that were not finished yet
+    std::vector<Shader*> pending;
+
+    // stages followed by the define set. The define set is a set: order and repeats do not make a new
+    // variant, defines is sorted and deduplicated in place
+    static std::string programKey(const std::string& stages, std::vector<std::string>& defines)
+    {
+        std::sort(defines.begin(), defines.end());
+        defines.erase(std::unique(defines.begin(), defines.end()), defines.end());
+        std::string key = stages;
+        for (const std::string& define : defines)
+            key += '\n' + define;
+        return key;
+    }
+
+    template<typename Create>
+    Shader& add(const std::string& key, Create create)
+    {
+        auto it = programs.find(key);
+        if (it != programs.end())
+        {
+            Reused++;
+            return *it->second;
+        }
+        Compiled++;
+        Shader& shader = *programs.emplace(key, create()).first->second;
+        pending.push_back(&shader);
+        return shader;
+    }
+};
+#endif
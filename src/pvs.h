@@ -0,0 +1,255 @@
+#ifndef PVS_H
+#define PVS_H
+
+#include <glm/glm.hpp>
+
+#include "map.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Potentially visible set of the labyrinth: for every open cell, the wall cells that can be seen from
+// anywhere inside it. Walls are full height, so visibility is solved in 2D by casting rays through the
+// grid from a few points of each open cell. Only valid while the camera is inside the maze, below the
+// top of the walls. Each cell stores the bounding rectangle of its visible walls plus a bitset of that
+// rectangle, which stays small since walls in a maze block almost everything.
+class PotentiallyVisibleSet
+{
+public:
+    PotentiallyVisibleSet() : rows(0), cols(0), revision(0), built(false)
+    {
+    }
+
+    // true when the set was built from the current labyrinth
+    bool current() const
+    {
+        return built && revision == mapRevision;
+    }
+
+    void build(float maxDistance = 100.0f)
+    {
+        rows = (int)labyrinth.size();
+        cols = rows > 0 ? (int)labyrinth[0].size() : 0;
+        entryOf.assign(rows * cols, -1);
+        entries.clear();
+        words.clear();
+
+        // hits of the cell being processed, stamp avoids clearing a map sized array per cell
+        std::vector<int> stamp(rows * cols, -1);
+        std::vector<int> hits;
+
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+                if (labyrinth[r][c] != 0) continue;
+                int cell = r * cols + c;
+                hits.clear();
+                for (float oz : SAMPLE_POSITIONS) {
+                    for (float ox : SAMPLE_POSITIONS) {
+                        for (int i = 0; i < RAY_COUNT; i++) {
+                            float angle = 2.0f * 3.14159265f * (i + 0.5f) / RAY_COUNT;
+                            int hit = castRay(c + ox, r + oz, std::cos(angle), std::sin(angle), maxDistance);
+                            if (hit >= 0 && stamp[hit] != cell) {
+                                stamp[hit] = cell;
+                                hits.push_back(hit);
+                            }
+                        }
+                    }
+                }
+                entryOf[cell] = (int)entries.size();
+                entries.push_back(makeEntry(hits));
+            }
+        }
+
+        revision = mapRevision;
+        built = true;
+    }
+
+    // cell index of a world position, -1 when outside the map or inside a wall
+    int cellAt(const glm::vec3& position) const
+    {
+        int r = (int)std::floor(position.z / BLOCK_SIDE);
+        int c = (int)std::floor(position.x / BLOCK_SIDE);
+        if (r < 0 || r >= rows || c < 0 || c >= cols) return -1;
+        return entryOf[r * cols + c] >= 0 ? r * cols + c : -1;
+    }
+
+    // whether the wall at row/col can be seen from cell
+    bool visible(int cell, int row, int col) const
+    {
+        const Entry& entry = entries[entryOf[cell]];
+        if (row < entry.rowMin || row > entry.rowMax || col < entry.colMin || col > entry.colMax) return false;
+        return bit(entry, row, col);
+    }
+
+    // whether any wall in rows [rowBegin, rowEnd) and columns [colBegin, colEnd) can be seen from cell
+    bool anyVisible(int cell, int rowBegin, int rowEnd, int colBegin, int colEnd) const
+    {
+        const Entry& entry = entries[entryOf[cell]];
+        int r0 = std::max(rowBegin, entry.rowMin), r1 = std::min(rowEnd - 1, entry.rowMax);
+        int c0 = std::max(colBegin, entry.colMin), c1 = std::min(colEnd - 1, entry.colMax);
+        for (int r = r0; r <= r1; r++)
+            for (int c = c0; c <= c1; c++)
+                if (bit(entry, r, c)) return true;
+        return false;
+    }
+
+    // the file is tied to the labyrinth it was built from through a hash of the cells
+    bool save(const std::string& path) const
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) return false;
+        uint32_t header[4] = { FILE_MAGIC, (uint32_t)rows, (uint32_t)cols, (uint32_t)entries.size() };
+        uint64_t hash = mapHash();
+        uint64_t wordCount = words.size();
+        file.write((const char*)header, sizeof(header));
+        file.write((const char*)&hash, sizeof(hash));
+        file.write((const char*)&wordCount, sizeof(wordCount));
+        file.write((const char*)entryOf.data(), entryOf.size() * sizeof(int));
+        file.write((const char*)entries.data(), entries.size() * sizeof(Entry));
+        file.write((const char*)words.data(), words.size() * sizeof(uint64_t));
+        return (bool)file;
+    }
+
+    // returns false if the file is missing, damaged or was built from a different labyrinth, it is rebuilt then
+    bool load(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        uint32_t header[4];
+        uint64_t hash, wordCount;
+        file.read((char*)header, sizeof(header));
+        file.read((char*)&hash, sizeof(hash));
+        file.read((char*)&wordCount, sizeof(wordCount));
+        int mapRows = (int)labyrinth.size();
+        int mapCols = mapRows > 0 ? (int)labyrinth[0].size() : 0;
+        if (!file || header[0] != FILE_MAGIC || (int)header[1] != mapRows || (int)header[2] != mapCols) return false;
+        rows = mapRows;
+        cols = mapCols;
+        if (hash != mapHash()) return false;
+        // at most an entry per cell, each with a bitset no larger than the map
+        uint64_t cells = (uint64_t)rows * cols;
+        if (header[3] > cells || wordCount > header[3] * ((cells + 63) / 64)) {
+            std::cout << "ERROR::PVS::FILE_CORRUPT: " << path << std::endl;
+            return false;
+        }
+
+        built = false;
+        entryOf.resize(rows * cols);
+        entries.resize(header[3]);
+        words.resize(wordCount);
+        file.read((char*)entryOf.data(), entryOf.size() * sizeof(int));
+        file.read((char*)entries.data(), entries.size() * sizeof(Entry));
+        file.read((char*)words.data(), words.size() * sizeof(uint64_t));
+        if (!file) {
+            std::cout << "ERROR::PVS::FILE_TRUNCATED: " << path << std::endl;
+            return false;
+        }
+        if (!valid()) {
+            std::cout << "ERROR::PVS::FILE_CORRUPT: " << path << std::endl;
+            return false;
+        }
+        revision = mapRevision;
+        built = true;
+        return true;
+    }
+
+private:
+    static const int RAY_COUNT = 720;
+    static constexpr float SAMPLE_POSITIONS[3] = { 0.02f, 0.5f, 0.98f };
+    static const uint32_t FILE_MAGIC = 0x31535650; // "PVS1"
+
+    struct Entry {
+        int rowMin, rowMax, colMin, colMax;
+        // first word of the rectangle's bitset in words
+        uint32_t firstWord;
+    };
+
+    int rows;
+    int cols;
+    // entry of every cell, -1 for walls
+    std::vector<int> entryOf;
+    std::vector<Entry> entries;
+    std::vector<uint64_t> words;
+    unsigned int revision;
+    bool built;
+
+    // whether every cell points at an entry and every entry's rectangle and bitset lie inside the map and words,
+    // so a damaged file can never make visible or anyVisible read out of bounds
+    bool valid() const
+    {
+        for (int entry : entryOf)
+            if (entry < -1 || entry >= (int)entries.size()) return false;
+        for (const Entry& entry : entries) {
+            // an entry without visible walls has an empty rectangle and no bitset
+            if (entry.rowMax < entry.rowMin || entry.colMax < entry.colMin) continue;
+            if (entry.rowMin < 0 || entry.rowMax >= rows || entry.colMin < 0 || entry.colMax >= cols) return false;
+            uint64_t bits = (uint64_t)(entry.rowMax - entry.rowMin + 1) * (entry.colMax - entry.colMin + 1);
+            if ((uint64_t)entry.firstWord + (bits + 63) / 64 > words.size()) return false;
+        }
+        return true;
+    }
+
+    bool bit(const Entry& entry, int row, int col) const
+    {
+        int width = entry.colMax - entry.colMin + 1;
+        int index = (row - entry.rowMin) * width + (col - entry.colMin);
+        return (words[entry.firstWord + index / 64] >> (index % 64)) & 1;
+    }
+
+    Entry makeEntry(const std::vector<int>& hits)
+    {
+        Entry entry = { 0, -1, 0, -1, (uint32_t)words.size() };
+        if (hits.empty()) return entry;
+        entry.rowMin = entry.colMin = 1 << 30;
+        entry.rowMax = entry.colMax = -1;
+        for (int hit : hits) {
+            entry.rowMin = std::min(entry.rowMin, hit / cols);
+            entry.rowMax = std::max(entry.rowMax, hit / cols);
+            entry.colMin = std::min(entry.colMin, hit % cols);
+            entry.colMax = std::max(entry.colMax, hit % cols);
+        }
+        int width = entry.colMax - entry.colMin + 1;
+        int height = entry.rowMax - entry.rowMin + 1;
+        words.resize(words.size() + (width * height + 63) / 64, 0);
+        for (int hit : hits) {
+            int index = (hit / cols - entry.rowMin) * width + (hit % cols - entry.colMin);
+            words[entry.firstWord + index / 64] |= 1ull << (index % 64);
+        }
+        return entry;
+    }
+
+    // walks the grid from (x, z) along (dx, dz), returns the first wall cell hit or -1
+    int castRay(float x, float z, float dx, float dz, float maxDistance) const
+    {
+        int c = (int)std::floor(x), r = (int)std::floor(z);
+        int stepC = dx > 0 ? 1 : -1, stepR = dz > 0 ? 1 : -1;
+        float deltaX = dx != 0.0f ? std::abs(1.0f / dx) : 1e30f;
+        float deltaZ = dz != 0.0f ? std::abs(1.0f / dz) : 1e30f;
+        float nextX = (dx > 0 ? (c + 1 - x) : (x - c)) * deltaX;
+        float nextZ = (dz > 0 ? (r + 1 - z) : (z - r)) * deltaZ;
+        while (true) {
+            float travelled;
+            if (nextX < nextZ) { c += stepC; travelled = nextX; nextX += deltaX; }
+            else               { r += stepR; travelled = nextZ; nextZ += deltaZ; }
+            if (travelled > maxDistance || r < 0 || r >= rows || c < 0 || c >= cols) return -1;
+            if (labyrinth[r][c] != 0) return r * cols + c;
+        }
+    }
+
+    uint64_t mapHash() const
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (const std::vector<int>& row : labyrinth)
+            for (int cell : row) {
+                hash ^= (uint64_t)cell;
+                hash *= 1099511628211ull;
+            }
+        return hash;
+    }
+};
+#endif
@@ -0,0 +1,227 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "shader.h"
+#include "transform.h"
+
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// texture unit of the texture array every material samples from, see material.glsl
+const unsigned int MATERIAL_TEXTURE_UNIT = 0;
+
+// layer of the material texture array, diffuse color and specular intensity packed together, -1 for
+// a material without one. Switching materials only sets the layer uniform, no texture is rebound.
+struct Material {
+    int layer;
+};
+
+// One draw call and everything needed to issue it. Per draw uniforms are limited to the ones every
+// program of the renderer understands: "model" and "normalMatrix" for GENERAL_TRANSFORM programs.
+// The program has to be the variant for the packet's transform, see model_transform.glsl, submitting
+// a model its variant cannot transform normals for is reported.
+struct DrawPacket {
+    Shader* shader;
+    unsigned int material;
+    unsigned int VAO;
+    GLenum mode;
+    int first;
+    int count;
+    // 0 for a regular draw, otherwise the number of instances
+    int instances;
+    glm::mat4 model;
+    // filled in on submission from model, TRANSFORM_GENERAL whenever the program is the general variant
+    TransformClass transform;
+    glm::mat3 normalMatrix;
+    // point used to sort the packet by distance to the camera
+    glm::vec3 center;
+    // culled, skipped by the next flush
+    bool hidden;
+};
+
+// Draws are submitted as packets and sorted once per frame on a 64 bit key, so programs, materials and
+// vertex arrays only change when they have to and opaque draws run front to back.
+//   bits 54-63  program   bits 42-53  material   bits 24-41  vertex array   bits 0-23  depth
+// Static packets (the walls) are kept across frames, only their depth is refreshed.
+class RenderQueue
+{
+public:
+    // draws issued by the last flush
+    unsigned int DrawCalls;
+
+    RenderQueue() : DrawCalls(0)
+    {
+        // material 0 sets nothing
+        materials.push_back(Material{ -1 });
+    }
+
+    unsigned int addMaterial(const Material& material)
+    {
+        materials.push_back(material);
+        return (unsigned int)materials.size() - 1;
+    }
+
+    // packets submitted here stay in the queue until clearStatic
+    void submitStatic(const DrawPacket& packet)
+    {
+        staticPackets.push_back(packet);
+        classify(staticPackets.back());
+    }
+
+    void clearStatic()
+    {
+        staticPackets.clear();
+    }
+
+    // lets culling switch cached packets off and on without resubmitting them
+    void setStaticHidden(unsigned int index, bool hidden)
+    {
+        staticPackets[index].hidden = hidden;
+    }
+
+    unsigned int staticCount() const
+    {
+        return (unsigned int)staticPackets.size();
+    }
+
+    // packets submitted here only live until the next flush
+    void submit(const DrawPacket& packet)
+    {
+        packets.push_back(packet);
+        classify(packets.back());
+    }
+
+    // sorts everything submitted and issues the draws, eye is used for the depth part of the key
+    void flush(const glm::vec3& eye, float farPlane)
+    {
+        unsigned int total = (unsigned int)(staticPackets.size() + packets.size());
+        keys.clear();
+        for (unsigned int i = 0; i < total; i++)
+        {
+            if (packetAt(i).hidden) continue;
+            keys.push_back(SortEntry{ makeKey(packetAt(i), eye, farPlane), i });
+        }
+        radixSort();
+
+        DrawCalls = 0;
+        Shader* shader = nullptr;
+        unsigned int material = NO_MATERIAL;
+        for (const SortEntry& entry : keys)
+        {
+            DrawPacket& packet = packetAt(entry.index);
+            if (packet.shader != shader)
+            {
+                shader = packet.shader;
+                shader->use();
+                // layers are uniforms of the program
+                material = NO_MATERIAL;
+            }
+            if (packet.material != material)
+            {
+                material = packet.material;
+                if (materials[material].layer >= 0) shader->setInt("material.layer", materials[material].layer);
+            }
+            glState.bindVertexArray(packet.VAO);
+
+            shader->setMat4("model", packet.model);
+            if (packet.transform == TRANSFORM_GENERAL) shader->setMat3("normalMatrix", packet.normalMatrix);
+
+            if (packet.instances > 0)
+                glDrawArraysInstanced(packet.mode, packet.first, packet.count, packet.instances);
+            else
+                glDrawArrays(packet.mode, packet.first, packet.count);
+            DrawCalls++;
+        }
+
+        packets.clear();
+    }
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        unsigned int index;
+    };
+    static const unsigned int NO_MATERIAL = 0xFFFFFFFF;
+
+    std::vector<Material> materials;
+    std::vector<DrawPacket> staticPackets;
+    std::vector<DrawPacket> packets;
+    std::vector<SortEntry> keys;
+    std::vector<SortEntry> scratch;
+    // GL names squeezed into the few bits the key has for them, in order of first use
+    std::unordered_map<unsigned int, unsigned int> programSlots;
+    std::unordered_map<unsigned int, unsigned int> vertexArraySlots;
+    // programs a mismatched transform was already reported for
+    std::unordered_set<const Shader*> mismatched;
+    static constexpr const char* TRANSFORM_NAMES[] = { "identity", "translation", "uniform scale", "general" };
+
+    // the normal matrix is only worked out for the programs that read it
+    void classify(DrawPacket& packet)
+    {
+        packet.transform = classifyTransform(packet.model);
+        TransformClass variant = packet.shader->Transform;
+        if (packet.transform > variant && mismatched.insert(packet.shader).second)
+            std::cout << "ERROR::RENDER_QUEUE::TRANSFORM_VARIANT_MISMATCH: program " << packet.shader->ID << " is the "
+                      << TRANSFORM_NAMES[variant] << " variant, drawn with a " << TRANSFORM_NAMES[packet.transform] << " model" << std::endl;
+        if (variant == TRANSFORM_GENERAL) packet.transform = TRANSFORM_GENERAL;
+        if (packet.transform == TRANSFORM_GENERAL) packet.normalMatrix = normalMatrix(packet.model);
+    }
+
+    DrawPacket& packetAt(unsigned int index)
+    {
+        return index < staticPackets.size() ? staticPackets[index] : packets[index - staticPackets.size()];
+    }
+
+    static unsigned int slot(std::unordered_map<unsigned int, unsigned int>& slots, unsigned int name)
+    {
+        auto it = slots.find(name);
+        if (it != slots.end()) return it->second;
+        unsigned int value = (unsigned int)slots.size();
+        slots.emplace(name, value);
+        return value;
+    }
+
+    uint64_t makeKey(const DrawPacket& packet, const glm::vec3& eye, float farPlane)
+    {
+        uint64_t program = slot(programSlots, packet.shader->ID) & 0x3FF;
+        uint64_t material = packet.material & 0xFFF;
+        uint64_t vertexArray = slot(vertexArraySlots, packet.VAO) & 0x3FFFF;
+        float distance = glm::length(packet.center - eye) / farPlane;
+        if (distance > 1.0f) distance = 1.0f;
+        uint64_t depth = (uint64_t)(distance * 0xFFFFFF);
+        return (program << 54) | (material << 42) | (vertexArray << 24) | depth;
+    }
+
+    // least significant digit radix sort, 8 bits per pass. Passes where every key has the same digit are
+    // skipped, which is most of them since only a handful of programs, materials and vertex arrays exist.
+    void radixSort()
+    {
+        scratch.resize(keys.size());
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            unsigned int histogram[256] = {};
+            for (const SortEntry& entry : keys)
+                histogram[(entry.key >> shift) & 0xFF]++;
+            if (histogram[(keys.empty() ? 0 : keys[0].key >> shift) & 0xFF] == keys.size()) continue;
+
+            unsigned int offset = 0;
+            for (unsigned int& bucket : histogram)
+            {
+                unsigned int bucketCount = bucket;
+                bucket = offset;
+                offset += bucketCount;
+            }
+            for (const SortEntry& entry : keys)
+                scratch[histogram[(entry.key >> shift) & 0xFF]++] = entry;
+            keys.swap(scratch);
+        }
+    }
+};
+#endif
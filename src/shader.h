@@ -4,141 +4,696 @@
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 
+#include "gl_state.h"
+#include "transform.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <fstream>
+#include <iterator>
 #include <sstream>
 #include <iostream>
 
+// directory #include "file" in shader sources is resolved against
+const std::string SHADER_INCLUDE_DIRECTORY = "res/shaders/";
+
+// FNV-1a hash, constexpr so literal uniform names can be hashed at compile time
+constexpr uint64_t fnv1aHash(std::string_view text)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : text) {
+        hash ^= (unsigned char)c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+constexpr uint64_t uniformHash(std::string_view name)
+{
+    return fnv1aHash(name);
+}
+
+// GL_KHR_parallel_shader_compile (and its ARB twin), not covered by the generated loader
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+enum ShaderCompile {
+    // the constructor waits for the program and checks it, the shader is ready to use
+    COMPILE_NOW,
+    // the constructor only starts compiling, call finish() before the shader is used or set up
+    COMPILE_DEFERRED
+};
+
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
-    // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
-    {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+    // most general model the program transforms normals right for, see model_transform.glsl. Worked out
+    // once the program is linked, so draws never look at its defines or sources
+    TransformClass Transform = TRANSFORM_GENERAL;
+    // programs linked from source and programs restored from the binary cache, over all shaders
+    static inline unsigned int ProgramsLinked = 0;
+    static inline unsigned int BinariesLoaded = 0;
+    // constructor generates the shader on the fly. Sources go through preprocess, so they can
+    // #include files from SHADER_INCLUDE_DIRECTORY and get a #define for every entry of defines.
+    // With COMPILE_DEFERRED the compile and link are only started, so several programs can be in
+    // flight before the first one is checked.
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines = {}, ShaderCompile compile = COMPILE_NOW)
+        : stages{ { GL_VERTEX_SHADER, vertexPath, "VERTEX" }, { GL_FRAGMENT_SHADER, fragmentPath, "FRAGMENT" } }, defines(defines)
+    {
+        submit();
+        if (compile == COMPILE_NOW) finish();
+    }
+    // transform feedback program: vertex and geometry stages only, the listed outputs are captured
+    // interleaved into the buffer bound to GL_TRANSFORM_FEEDBACK_BUFFER binding 0
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const char* geometryPath, const std::vector<std::string>& defines, const std::vector<const char*>& feedbackVaryings,
+           ShaderCompile compile = COMPILE_NOW)
+        : stages{ { GL_VERTEX_SHADER, vertexPath, "VERTEX" }, { GL_GEOMETRY_SHADER, geometryPath, "GEOMETRY" } }, defines(defines),
+          feedbackVaryings(feedbackVaryings.begin(), feedbackVaryings.end())
+    {
+        submit();
+        if (compile == COMPILE_NOW) finish();
+    }
+    // true once a deferred compile can be finished without waiting. Without parallel compilation the
+    // driver gives no such hint and this is always true.
+    // ------------------------------------------------------------------------
+    bool ready() const
+    {
+        if (!pending || !parallelCompile) return true;
+        GLint done = 0;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+        return done != 0;
+    }
+    // waits for a deferred compile, reports its errors and gets the shader ready to use. Uniforms can
+    // only be set after this. Returns whether the program linked.
+    // ------------------------------------------------------------------------
+    bool finish()
+    {
+        if (!pending) return linked;
+        pending = false;
+        for (const PendingStage& stage : pendingStages)
+        {
+            if (checkCompileErrors(stage.shader, stage.typeName)) continue;
+            for (size_t i = 0; i < stage.files.size(); i++)
+                std::cout << "  source " << i << ": " << stage.files[i] << std::endl;
+        }
+        linked = checkCompileErrors(ID, "PROGRAM");
         // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        for (const PendingStage& stage : pendingStages)
+        {
+            glDetachShader(ID, stage.shader);
+            glDeleteShader(stage.shader);
+        }
+        pendingStages.clear();
+        if (linked && !binaryPath.empty()) saveBinary(binaryPath);
+        binaryPath.clear();
+        Transform = transformVariant();
+        // resolve every uniform location once, setters never query GL for them
+        cacheUniforms();
+        bindUniformBlocks();
+        return linked;
+    }
+    // draws a triangle of vertexArray with this program so the driver builds whatever it compiles lazily on
+    // first use now rather than during the first frame. It draws into the bound framebuffer, do it before a clear.
+    // ------------------------------------------------------------------------
+    void prewarm(unsigned int vertexArray)
+    {
+        use();
+        glState.bindVertexArray(vertexArray);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    // lets the driver compile and link on its own threads when it supports GL_KHR_parallel_shader_compile,
+    // so deferred compiles run in parallel. load resolves the extension entry point.
+    // ------------------------------------------------------------------------
+    static void enableParallelCompile(GLADloadfunc load)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count && !parallelCompile; i++)
+        {
+            std::string_view extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            const char* entryPoint = extension == "GL_KHR_parallel_shader_compile" ? "glMaxShaderCompilerThreadsKHR" :
+                                     extension == "GL_ARB_parallel_shader_compile" ? "glMaxShaderCompilerThreadsARB" : nullptr;
+            if (!entryPoint) continue;
+            auto maxShaderCompilerThreads = (void (*)(GLuint))load(entryPoint);
+            if (!maxShaderCompilerThreads) continue;
+            // as many threads as the implementation likes
+            maxShaderCompilerThreads(0xFFFFFFFF);
+            parallelCompile = true;
+        }
+    }
+    // linked programs are saved to directory and restored from it on later runs instead of being compiled,
+    // as long as the preprocessed sources and the driver are the same. Each program has one file, replaced
+    // whenever the program is linked again. Call once after the context is current, does nothing if the
+    // driver has no program binary formats.
+    // ------------------------------------------------------------------------
+    static void enableBinaryCache(const std::string& directory)
+    {
+        GLint formats = 0;
+        if (GLAD_GL_VERSION_4_1) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (formats == 0) return;
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        if (error)
+        {
+            std::cout << "ERROR::SHADER::BINARY_CACHE_UNAVAILABLE: " << directory << std::endl;
+            return;
+        }
+        binaryCacheDirectory = directory;
+        // binaries only fit the driver that produced them
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+        {
+            const GLubyte* value = glGetString(name);
+            driverKey += value ? (const char*)value : "";
+            driverKey += '\n';
+        }
+    }
+    // reads path and resolves every #include "file" against SHADER_INCLUDE_DIRECTORY, each file is pasted
+    // at most once. defines ("NAME" or "NAME VALUE") are added right after #version. #line directives
+    // keep compiler messages pointing at the right line, the source string number is the index in files.
+    // ------------------------------------------------------------------------
+    static std::string preprocess(const char* path, const std::vector<std::string>& defines, std::vector<std::string>& files)
+    {
+        files.clear();
+        std::string source = expandIncludes(path, files);
 
+        std::string header;
+        for (const std::string& define : defines)
+            header += "#define " + define + "\n";
+        // #version has to stay the first directive
+        size_t version = source.find("#version");
+        size_t insertAt = 0;
+        int nextLine = 1;
+        if (version != std::string::npos)
+        {
+            size_t lineEnd = source.find('\n', version);
+            insertAt = lineEnd == std::string::npos ? source.size() : lineEnd + 1;
+            nextLine = 1 + (int)std::count(source.begin(), source.begin() + insertAt, '\n');
+            if (lineEnd == std::string::npos) header = "\n" + header;
+        }
+        source.insert(insertAt, header + "#line " + std::to_string(nextLine) + " 0\n");
+        return source;
+    }
+    // every program linked after this call gets its uniform block called name bound to binding
+    // ------------------------------------------------------------------------
+    static void bindUniformBlock(const std::string& name, unsigned int binding)
+    {
+        uniformBlockBindings.push_back({ name, binding });
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
     { 
-        glUseProgram(ID); 
+        glState.useProgram(ID); 
     }
     // utility uniform functions
+    // the shader has to be in use, values equal to the last one uploaded to a uniform are skipped
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
+    void setBool(std::string_view name, bool value)
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        setInt(name, (int)value);
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
+    void setInt(std::string_view name, int value)
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        if (Uniform* u = changed(name, value)) glUniform1i(u->location, value); 
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
+    void setFloat(std::string_view name, float value)
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        if (Uniform* u = changed(name, value)) glUniform1f(u->location, value); 
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
+    void setVec2(std::string_view name, const glm::vec2 &value)
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        if (Uniform* u = changed(name, value)) glUniform2fv(u->location, 1, &value[0]); 
     }
-    void setVec2(const std::string &name, float x, float y) const
+    void setVec2(std::string_view name, float x, float y)
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        setVec2(name, glm::vec2(x, y)); 
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
+    void setVec3(std::string_view name, const glm::vec3 &value)
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        if (Uniform* u = changed(name, value)) glUniform3fv(u->location, 1, &value[0]); 
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
+    void setVec3(std::string_view name, float x, float y, float z)
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        setVec3(name, glm::vec3(x, y, z)); 
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
+    void setVec4(std::string_view name, const glm::vec4 &value)
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        if (Uniform* u = changed(name, value)) glUniform4fv(u->location, 1, &value[0]); 
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) const
+    void setVec4(std::string_view name, float x, float y, float z, float w)
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        setVec4(name, glm::vec4(x, y, z, w)); 
+    }
+    // sets the first count elements of the vec4 array name with one upload, skipped if none of them changed.
+    // count may not exceed the length the array is declared with
+    void setVec4Array(std::string_view name, const glm::vec4* values, int count)
+    {
+        auto it = uniformIndex.find(uniformHash(name));
+        if (it == uniformIndex.end()) return;
+        const Uniform& first = uniforms[it->second];
+        if (first.type != GL_FLOAT_VEC4 || count > first.size)
+        {
+            std::cout << "ERROR::SHADER::UNIFORM_ARRAY_MISMATCH: " << name << " is not a vec4 array of " << count << " elements" << std::endl;
+            return;
+        }
+        // elements have consecutive slots from the one of name, and consecutive locations
+        bool dirty = false;
+        for (int i = 0; i < count; i++)
+        {
+            Uniform& u = uniforms[it->second + i];
+            if (u.assigned && std::memcmp(u.value, &values[i], sizeof(glm::vec4)) == 0) continue;
+            std::memcpy(u.value, &values[i], sizeof(glm::vec4));
+            u.assigned = true;
+            dirty = true;
+        }
+        if (dirty) glUniform4fv(uniforms[it->second].location, count, &values[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    void setMat2(std::string_view name, const glm::mat2 &mat)
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        if (Uniform* u = changed(name, mat)) glUniformMatrix2fv(u->location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    void setMat3(std::string_view name, const glm::mat3 &mat)
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        if (Uniform* u = changed(name, mat)) glUniformMatrix3fv(u->location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    void setMat4(std::string_view name, const glm::mat4 &mat)
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        if (Uniform* u = changed(name, mat)) glUniformMatrix4fv(u->location, 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    friend class ShaderReloader;
+
+    // location and type of an active uniform and a copy of the last value uploaded to it
+    struct Uniform {
+        GLint location;
+        GLenum type;
+        // elements from this one to the end of its array, 1 for a uniform that is not an array
+        GLint size;
+        bool assigned;
+        float value[16];
+    };
+    std::vector<Uniform> uniforms;
+    // name hash -> index in uniforms, array uniforms are reachable as "name", "name[0]", "name[1]"...
+    std::unordered_map<uint64_t, int> uniformIndex;
+    // uniform blocks shared by all programs, see bindUniformBlock
+    static inline std::vector<std::pair<std::string, unsigned int>> uniformBlockBindings;
+    // where linked programs are cached, empty when the binary cache is off
+    static inline std::string binaryCacheDirectory;
+    static inline std::string driverKey;
+
+    // the driver compiles and links on its own threads, see enableParallelCompile
+    static inline bool parallelCompile = false;
+
+    struct Stage {
+        GLenum type;
+        std::string path;
+        const char* typeName;
+    };
+    // how the program is built, kept so it can be built again when its sources change
+    std::vector<Stage> stages;
+    std::vector<std::string> defines;
+    std::vector<std::string> feedbackVaryings;
+    // every file the sources were preprocessed from, includes too
+    std::vector<std::string> sourceFiles;
+    // a compiled shader whose status has not been checked yet, files are the sources it was built from
+    struct PendingStage {
+        unsigned int shader;
+        const char* typeName;
+        std::vector<std::string> files;
+    };
+    std::vector<PendingStage> pendingStages;
+    // binary cache file the program is saved to once linked, empty if not saved
+    std::string binaryPath;
+    // hash of the driver and the preprocessed sources, a cached binary is only used if it was saved with the same
+    uint64_t binaryKey = 0;
+    // compile started and finish() not called yet
+    bool pending = false;
+    bool linked = false;
+
+    // rebuilds recipe from sources that were already preprocessed, see ShaderReloader. finish() it before use
+    Shader(const Shader& recipe, const std::vector<std::string>& sources, std::vector<std::vector<std::string>> files)
+        : stages(recipe.stages), defines(recipe.defines), feedbackVaryings(recipe.feedbackVaryings)
+    {
+        submit(sources, files);
+    }
+
+    // 1. preprocess shaders, the binary cache is keyed on the result
+    std::vector<std::string> preprocessStages(std::vector<std::vector<std::string>>& files) const
+    {
+        std::vector<std::string> sources(stages.size());
+        files.resize(stages.size());
+        for (size_t i = 0; i < stages.size(); i++)
+            sources[i] = preprocess(stages[i].path.c_str(), defines, files[i]);
+        return sources;
+    }
+
+    void submit()
+    {
+        std::vector<std::vector<std::string>> files;
+        std::vector<std::string> sources = preprocessStages(files);
+        submit(sources, files);
+    }
+
+    // issues the compile and link without asking GL for any status, finish() checks the results
+    void submit(const std::vector<std::string>& sources, std::vector<std::vector<std::string>>& files)
+    {
+        sourceFiles.clear();
+        for (const std::vector<std::string>& stageFiles : files)
+            for (const std::string& file : stageFiles)
+                if (std::find(sourceFiles.begin(), sourceFiles.end(), file) == sourceFiles.end()) sourceFiles.push_back(file);
+
+        ID = glCreateProgram();
+        pending = true;
+        binaryPath = binaryCachePath();
+        binaryKey = binaryCacheKey(sources);
+        if (!binaryPath.empty() && loadBinary(binaryPath))
+        {
+            // nothing left to compile or save
+            binaryPath.clear();
+            return;
+        }
+        // 2. compile shaders
+        for (size_t i = 0; i < stages.size(); i++)
+        {
+            pendingStages.push_back(PendingStage{ compile(stages[i].type, sources[i]), stages[i].typeName, std::move(files[i]) });
+            glAttachShader(ID, pendingStages.back().shader);
+        }
+        // 3. shader Program, transform feedback varyings have to be declared before linking
+        if (!feedbackVaryings.empty())
+        {
+            std::vector<const char*> varyings;
+            for (const std::string& varying : feedbackVaryings) varyings.push_back(varying.c_str());
+            glTransformFeedbackVaryings(ID, (GLsizei)varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+        }
+        if (!binaryPath.empty()) glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(ID);
+        ProgramsLinked++;
+    }
+
+    // file the program is cached in, empty when the cache is off. It is named after what the program is built
+    // from (stage files, defines and captured outputs), not their contents, so a program rebuilt after its
+    // sources changed overwrites its old binary instead of adding one more file to the cache
+    std::string binaryCachePath() const
+    {
+        if (binaryCacheDirectory.empty()) return std::string();
+        std::string identity;
+        for (const Stage& stage : stages) identity += std::string(stage.typeName) + ' ' + stage.path + '\0';
+        for (const std::string& define : defines) identity += define + '\0';
+        for (const std::string& varying : feedbackVaryings) identity += varying + '\0';
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)fnv1aHash(identity));
+        return binaryCacheDirectory + "/" + name;
+    }
+
+    // what a cached binary has to match to be used, the driver and the preprocessed sources
+    uint64_t binaryCacheKey(const std::vector<std::string>& sources) const
+    {
+        std::string key = driverKey;
+        for (const std::string& source : sources) key += source + '\0';
+        for (const std::string& varying : feedbackVaryings) key += varying + '\0';
+        return fnv1aHash(key);
+    }
+
+    // restores the program from a cached binary, false if there is none, it was saved from other sources or
+    // by another driver, or the driver rejects it
+    bool loadBinary(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        uint64_t key = 0;
+        GLenum format = 0;
+        if (!file.read((char*)&key, sizeof(key)) || key != binaryKey) return false;
+        if (!file.read((char*)&format, sizeof(format))) return false;
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (binary.empty()) return false;
+
+        glProgramBinary(ID, format, binary.data(), (GLsizei)binary.size());
+        GLint success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (!success) return false;
+        BinariesLoaded++;
+        return true;
+    }
+
+    void saveBinary(const std::string& path) const
+    {
+        GLint length = 0;
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(ID, length, &length, &format, binary.data());
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write((const char*)&binaryKey, sizeof(binaryKey));
+        file.write((const char*)&format, sizeof(format));
+        file.write(binary.data(), length);
+        if (!file)
+            std::cout << "ERROR::SHADER::BINARY_NOT_SUCCESSFULLY_WRITTEN: " << path << std::endl;
+    }
+
+    // the transform variant the program was built as, from its defines and whether it includes model_transform.glsl.
+    // Programs without it have no normals to get wrong, they take any model
+    TransformClass transformVariant() const
+    {
+        if (!usesSource("model_transform.glsl") || hasDefine("GENERAL_TRANSFORM")) return TRANSFORM_GENERAL;
+        if (hasDefine("IDENTITY_TRANSFORM")) return TRANSFORM_IDENTITY;
+        return TRANSFORM_UNIFORM_SCALE;
+    }
+
+    // whether define (its name, without a value) was given to the program
+    bool hasDefine(std::string_view name) const
+    {
+        for (const std::string& define : defines)
+            if (std::string_view(define).substr(0, define.find(' ')) == name) return true;
+        return false;
+    }
+
+    // whether one of the program's sources, includes too, is the file called name
+    bool usesSource(std::string_view name) const
+    {
+        for (const std::string& file : sourceFiles)
+            if (std::filesystem::path(file).filename() == name) return true;
+        return false;
+    }
+
+    void bindUniformBlocks()
+    {
+        for (const auto& block : uniformBlockBindings)
+        {
+            GLuint index = glGetUniformBlockIndex(ID, block.first.c_str());
+            if (index != GL_INVALID_INDEX) glUniformBlockBinding(ID, index, block.second);
+        }
+    }
+
+    // queries the active uniforms of the linked program, this is the only place locations are looked up
+    // ------------------------------------------------------------------------
+    void cacheUniforms()
+    {
+        uniforms.clear();
+        uniformIndex.clear();
+
+        GLint count = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLchar name[256];
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, i, sizeof(name), &length, &size, &type, name);
+            std::string_view fullName(name, length);
+
+            // arrays are reported once as "name[0]", every element gets its own slot
+            if (fullName.size() > 3 && fullName.substr(fullName.size() - 3) == "[0]")
+            {
+                std::string base(fullName.substr(0, fullName.size() - 3));
+                for (GLint element = 0; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    int slot = addUniform(elementName, glGetUniformLocation(ID, elementName.c_str()), type, size - element);
+                    if (element == 0 && slot >= 0) addAlias(base, slot);
+                }
+            }
+            else
+            {
+                addUniform(fullName, glGetUniformLocation(ID, name), type, 1);
+            }
+        }
+    }
+
+    int addUniform(std::string_view name, GLint location, GLenum type, GLint size)
+    {
+        // members of uniform blocks have no location
+        if (location < 0) return -1;
+        uniforms.push_back(Uniform{ location, type, size, false, {} });
+        addAlias(name, (int)uniforms.size() - 1);
+        return (int)uniforms.size() - 1;
+    }
+
+    void addAlias(std::string_view name, int slot)
+    {
+        if (!uniformIndex.emplace(uniformHash(name), slot).second)
+            std::cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION: " << name << std::endl;
+    }
+
+    // returns the uniform to upload to, or nullptr if it does not exist or already holds this value
+    // ------------------------------------------------------------------------
+    template<typename T>
+    Uniform* changed(std::string_view name, const T& value)
+    {
+        static_assert(sizeof(T) <= sizeof(Uniform::value), "uniform value too large");
+        auto it = uniformIndex.find(uniformHash(name));
+        if (it == uniformIndex.end()) return nullptr;
+        Uniform& u = uniforms[it->second];
+        if (u.assigned && std::memcmp(u.value, &value, sizeof(T)) == 0) return nullptr;
+        std::memcpy(u.value, &value, sizeof(T));
+        u.assigned = true;
+        return &u;
+    }
+
+    // takes over the finished program of replacement and uploads every uniform value set on this shader
+    // to it, the uniforms keep their values across a reload. The old program is deleted.
+    // ------------------------------------------------------------------------
+    void adopt(Shader& replacement)
+    {
+        glState.forgetProgram(ID);
+        glDeleteProgram(ID);
+        ID = replacement.ID;
+        replacement.ID = 0;
+        sourceFiles = std::move(replacement.sourceFiles);
+        Transform = replacement.Transform;
+
+        std::vector<Uniform> previous = std::move(uniforms);
+        std::unordered_map<uint64_t, int> previousIndex = std::move(uniformIndex);
+        uniforms = std::move(replacement.uniforms);
+        uniformIndex = std::move(replacement.uniformIndex);
+        use();
+        for (const auto& entry : previousIndex)
+        {
+            const Uniform& old = previous[entry.second];
+            auto it = uniformIndex.find(entry.first);
+            if (!old.assigned || it == uniformIndex.end()) continue;
+            Uniform& u = uniforms[it->second];
+            // a uniform whose type changed keeps the default of the new program
+            if (u.type != old.type) continue;
+            std::memcpy(u.value, old.value, sizeof(u.value));
+            u.assigned = true;
+            upload(u);
+        }
+    }
+
+    // uploads the shadow value of a uniform with the call matching its type
+    static void upload(const Uniform& u)
+    {
+        switch (u.type)
+        {
+        case GL_FLOAT:      glUniform1fv(u.location, 1, u.value); break;
+        case GL_FLOAT_VEC2: glUniform2fv(u.location, 1, u.value); break;
+        case GL_FLOAT_VEC3: glUniform3fv(u.location, 1, u.value); break;
+        case GL_FLOAT_VEC4: glUniform4fv(u.location, 1, u.value); break;
+        case GL_FLOAT_MAT2: glUniformMatrix2fv(u.location, 1, GL_FALSE, u.value); break;
+        case GL_FLOAT_MAT3: glUniformMatrix3fv(u.location, 1, GL_FALSE, u.value); break;
+        case GL_FLOAT_MAT4: glUniformMatrix4fv(u.location, 1, GL_FALSE, u.value); break;
+        default:
+        {
+            // ints, bools and samplers, all set through setInt
+            GLint value;
+            std::memcpy(&value, u.value, sizeof(value));
+            glUniform1i(u.location, value);
+        }
+        }
+    }
+
+    // starts compiling one stage from its preprocessed source, the status is checked by finish()
+    static unsigned int compile(GLenum type, const std::string& code)
+    {
+        const char* shaderCode = code.c_str();
+        unsigned int shader = glCreateShader(type);
+        glShaderSource(shader, 1, &shaderCode, NULL);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    // pastes the includes of path in place, files lists every file already pasted
+    static std::string expandIncludes(const std::string& path, std::vector<std::string>& files)
+    {
+        int fileIndex = (int)files.size();
+        files.push_back(path);
+        std::istringstream input(readFile(path.c_str()));
+        std::string output;
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(input, line))
+        {
+            lineNumber++;
+            size_t directive = line.find_first_not_of(" \t");
+            if (directive == std::string::npos || line.compare(directive, 8, "#include") != 0)
+            {
+                output += line + "\n";
+                continue;
+            }
+            size_t open = line.find('"', directive);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos)
+            {
+                std::cout << "ERROR::SHADER::MALFORMED_INCLUDE: " << path << ":" << lineNumber << std::endl;
+                output += "\n";
+                continue;
+            }
+            std::string includePath = SHADER_INCLUDE_DIRECTORY + line.substr(open + 1, close - open - 1);
+            if (std::find(files.begin(), files.end(), includePath) != files.end())
+            {
+                // already pasted, keep the line count
+                output += "\n";
+                continue;
+            }
+            int includeIndex = (int)files.size();
+            output += "#line 1 " + std::to_string(includeIndex) + "\n";
+            output += expandIncludes(includePath, files);
+            output += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+        }
+        return output;
+    }
+
+    static std::string readFile(const char* path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return std::string();
+        }
+        std::stringstream stream;
+        stream << file.rdbuf();
+        return stream.str();
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    static bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -160,6 +715,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
 };
 #endif
@@ -0,0 +1,234 @@
+#ifndef SHADER_RELOADER_H
+#define SHADER_RELOADER_H
+
+#include <glad/gl.h>
+
+#include "shader.h"
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Live shader reloading. A worker thread watches the shader directory with inotify and preprocesses the
+// watched programs whose files changed, includes too. update() compiles them without waiting (on the
+// driver's threads where it compiles in parallel) and swaps each one into its Shader at the frame boundary
+// once it linked, with the uniform values the Shader had. A program that fails keeps the previous one.
+// inotify is Linux only, elsewhere nothing is watched.
+class ShaderReloader
+{
+public:
+    // programs swapped in, and programs that failed to build and were dropped
+    unsigned int Reloaded;
+    unsigned int Failed;
+
+    ShaderReloader(const std::string& directory = SHADER_INCLUDE_DIRECTORY) : Reloaded(0), Failed(0), directory(directory),
+        inotifyFd(-1), stopping(false)
+    {
+        if (!this->directory.empty() && this->directory.back() != '/') this->directory += '/';
+#ifdef __linux__
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        // editors either rewrite the file in place or write a new one and rename it over the old one
+        if (inotifyFd < 0 || inotify_add_watch(inotifyFd, this->directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+        {
+            std::cout << "ERROR::SHADER::DIRECTORY_NOT_WATCHED: " << this->directory << std::endl;
+            return;
+        }
+        worker = std::thread(&ShaderReloader::workerLoop, this);
+#endif
+    }
+
+    ~ShaderReloader()
+    {
+        stopWorker();
+    }
+
+    // reloads shader whenever a file it was built from changes, shader must outlive the reloader
+    void watch(Shader& shader)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        watched.push_back(Watched{ &shader, shader.sourceFiles });
+    }
+
+    // starts compiling what the worker preprocessed and swaps in the programs that are done, call once per frame
+    void update()
+    {
+        std::deque<Preprocessed> preprocessed;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            preprocessed.swap(results);
+        }
+        for (Preprocessed& result : preprocessed)
+        {
+            // edited again while the previous edit was compiling, only the newest one is kept
+            for (auto it = reloads.begin(); it != reloads.end(); ++it)
+            {
+                if (it->target != result.target) continue;
+                drop(*it->replacement);
+                reloads.erase(it);
+                break;
+            }
+            reloads.push_back(Reload{ result.target, std::unique_ptr<Shader>(new Shader(*result.target, result.sources, std::move(result.files))) });
+        }
+
+        for (auto it = reloads.begin(); it != reloads.end();)
+        {
+            Shader& replacement = *it->replacement;
+            if (!replacement.ready()) { ++it; continue; }
+            if (replacement.finish())
+            {
+                it->target->adopt(replacement);
+                Reloaded++;
+                std::cout << "Reloaded " << describe(*it->target) << std::endl;
+            }
+            else
+            {
+                drop(replacement);
+                Failed++;
+                std::cout << "ERROR::SHADER::RELOAD_FAILED, keeping the previous program of " << describe(*it->target) << std::endl;
+            }
+            it = reloads.erase(it);
+        }
+    }
+
+    void release()
+    {
+        stopWorker();
+        for (Reload& reload : reloads) drop(*reload.replacement);
+        reloads.clear();
+    }
+
+private:
+    struct Watched {
+        Shader* shader;
+        // files its sources were last preprocessed from
+        std::vector<std::string> files;
+    };
+    // sources the worker preprocessed for a changed program
+    struct Preprocessed {
+        Shader* target;
+        std::vector<std::string> sources;
+        std::vector<std::vector<std::string>> files;
+    };
+    // a replacement program that is still compiling
+    struct Reload {
+        Shader* target;
+        std::unique_ptr<Shader> replacement;
+    };
+
+    std::string directory;
+    int inotifyFd;
+    std::thread worker;
+    std::mutex mutex;
+    bool stopping;
+    std::vector<Watched> watched;
+    std::deque<Preprocessed> results;
+    std::vector<Reload> reloads;
+
+    static void drop(Shader& replacement)
+    {
+        replacement.finish();
+        glDeleteProgram(replacement.ID);
+        replacement.ID = 0;
+    }
+
+    static std::string describe(const Shader& shader)
+    {
+        std::string name;
+        for (const Shader::Stage& stage : shader.stages)
+            name += (name.empty() ? "" : " + ") + stage.path;
+        return name;
+    }
+
+#ifdef __linux__
+    void workerLoop()
+    {
+        std::vector<std::string> changed;
+        alignas(inotify_event) char buffer[4096];
+        while (true)
+        {
+            // once something changed, wait until the directory is quiet for a moment: a save can be several events
+            pollfd descriptor = { inotifyFd, POLLIN, 0 };
+            int events = poll(&descriptor, 1, changed.empty() ? 200 : 50);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stopping) return;
+            }
+            if (events > 0)
+            {
+                ssize_t length;
+                while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+                {
+                    for (char* cursor = buffer; cursor < buffer + length;)
+                    {
+                        const inotify_event* event = (const inotify_event*)cursor;
+                        if (event->len > 0) changed.push_back(directory + event->name);
+                        cursor += sizeof(inotify_event) + event->len;
+                    }
+                }
+                continue;
+            }
+            if (changed.empty()) continue;
+
+            std::vector<Shader*> targets;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (const Watched& entry : watched)
+                {
+                    bool affected = std::any_of(entry.files.begin(), entry.files.end(), [&](const std::string& file) {
+                        return std::find(changed.begin(), changed.end(), file) != changed.end();
+                    });
+                    if (affected) targets.push_back(entry.shader);
+                }
+            }
+            changed.clear();
+
+            // only the recipe of the shader is read here, the main thread never changes it
+            for (Shader* target : targets)
+            {
+                Preprocessed result;
+                result.target = target;
+                result.sources = target->preprocessStages(result.files);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                // includes may have been added or removed
+                for (Watched& entry : watched)
+                {
+                    if (entry.shader != target) continue;
+                    entry.files.clear();
+                    for (const std::vector<std::string>& stageFiles : result.files)
+                        entry.files.insert(entry.files.end(), stageFiles.begin(), stageFiles.end());
+                }
+                results.push_back(std::move(result));
+            }
+        }
+    }
+#endif
+
+    void stopWorker()
+    {
+        if (worker.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            worker.join();
+        }
+#ifdef __linux__
+        if (inotifyFd >= 0) close(inotifyFd);
+#endif
+        inotifyFd = -1;
+    }
+};
+#endif
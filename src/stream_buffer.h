@@ -0,0 +1,187 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/gl.h>
+
+#include "gl_state.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Ring of per-frame GPU data: instances, uniform blocks and anything else rewritten every frame.
+// One buffer is split into a region per frame in flight and every write of a frame goes into that frame's
+// region, at an offset the caller binds (glBindBufferRange, glVertexAttribPointer). A fence is placed when the
+// frame is done, and a region is only written again after its fence signaled, so the writes map the buffer
+// unsynchronized and never wait for the GPU to finish reading the previous contents like glBufferSubData can.
+// The fence only covers the draws of the frame that wrote the data, so data is only valid in that frame and
+// whatever is still needed in the next one has to be written again. A frame that needs more than FrameSize moves
+// to a larger buffer on the spot, ID changes and the old buffer is deleted once the GPU is done with it.
+class StreamBuffer
+{
+public:
+    static const unsigned int FRAMES_IN_FLIGHT = 3;
+
+    unsigned int ID;
+    // bytes of each frame's region, doubled when a frame needs more
+    size_t FrameSize;
+    // frames started so far
+    uint64_t Frame;
+    // bytes written by the last finished frame
+    size_t LastUsed;
+    // times beginFrame had to wait for the GPU to release a region
+    unsigned int Waits;
+    // offset alignment required by glBindBufferRange on GL_UNIFORM_BUFFER
+    size_t UniformAlignment;
+
+    StreamBuffer(size_t frameSize) : ID(0), FrameSize(frameSize), Frame(0), LastUsed(0), Waits(0), UniformAlignment(256),
+        cursor(0)
+    {
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        if (alignment > 0) UniformAlignment = (size_t)alignment;
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++) fences[i] = 0;
+        glGenBuffers(1, &ID);
+        allocate();
+    }
+
+    // call at the start of every frame, after the previous frame's last draw. Fences the frame that ended and
+    // waits for the GPU to be done with the region the new frame writes into, which was written
+    // FRAMES_IN_FLIGHT - 1 frames ago
+    void beginFrame()
+    {
+        unsigned int region = (unsigned int)(Frame % FRAMES_IN_FLIGHT);
+        LastUsed = cursor - region * FrameSize;
+        if (LastUsed > 0) fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        Frame++;
+        releaseRetired();
+
+        region = (unsigned int)(Frame % FRAMES_IN_FLIGHT);
+        if (fences[region])
+        {
+            // the first check only flushes, a wait is only counted when the GPU is really behind
+            GLenum status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (status == GL_TIMEOUT_EXPIRED)
+            {
+                Waits++;
+                while (status == GL_TIMEOUT_EXPIRED)
+                    status = glClientWaitSync(fences[region], 0, 1000000000);
+            }
+            if (status == GL_WAIT_FAILED)
+                std::cout << "ERROR::STREAM_BUFFER::WAIT_FAILED" << std::endl;
+            deleteFence(region);
+        }
+        cursor = region * FrameSize;
+    }
+
+    // copies size bytes into this frame's region and returns their offset in ID, aligned to alignment (a power
+    // of two). Leaves ID bound to GL_ARRAY_BUFFER. Read ID after the write, it changes when the region is full
+    GLintptr write(const void* data, size_t size, size_t alignment = 16)
+    {
+        unsigned int region = (unsigned int)(Frame % FRAMES_IN_FLIGHT);
+        size_t offset = (cursor + alignment - 1) & ~(alignment - 1);
+        if (offset + size > (region + 1) * FrameSize)
+        {
+            grow(size + alignment);
+            offset = (cursor + alignment - 1) & ~(alignment - 1);
+        }
+        cursor = offset + size;
+
+        glState.bindBuffer(GL_ARRAY_BUFFER, ID);
+        if (size == 0) return (GLintptr)offset;
+        // the fence of this region signaled, nothing the GPU still reads is in the range
+        void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, (GLintptr)offset, (GLsizeiptr)size,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (mapped)
+        {
+            std::memcpy(mapped, data, size);
+            if (glUnmapBuffer(GL_ARRAY_BUFFER)) return (GLintptr)offset;
+        }
+        // the range could not be mapped or its contents got lost, an ordinary upload still gets it there
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)offset, (GLsizeiptr)size, data);
+        return (GLintptr)offset;
+    }
+
+    void release()
+    {
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++) deleteFence(i);
+        for (Retired& buffer : retired)
+        {
+            if (buffer.fence) glDeleteSync(buffer.fence);
+            glState.forgetBuffer(buffer.ID);
+            glDeleteBuffers(1, &buffer.ID);
+        }
+        retired.clear();
+        glState.forgetBuffer(ID);
+        glDeleteBuffers(1, &ID);
+        ID = 0;
+    }
+
+private:
+    // a buffer replaced by a larger one, deleted once fence signaled. The fence is placed when the frame that
+    // replaced it ends, it is 0 until then
+    struct Retired {
+        unsigned int ID;
+        GLsync fence;
+    };
+
+    GLsync fences[FRAMES_IN_FLIGHT];
+    // end of the data written so far in this frame's region
+    size_t cursor;
+    std::vector<Retired> retired;
+
+    // moves to a new buffer whose regions hold what this frame wrote so far plus bytes more. What was written
+    // stays in the old buffer, which the draws already recorded read from, so it is kept until they are done
+    void grow(size_t bytes)
+    {
+        unsigned int region = (unsigned int)(Frame % FRAMES_IN_FLIGHT);
+        size_t used = cursor - region * FrameSize;
+        while (FrameSize < used + bytes) FrameSize *= 2;
+        retired.push_back(Retired{ ID, 0 });
+        // the fences cover regions of the old buffer, nothing of the new one is busy
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++) deleteFence(i);
+        glGenBuffers(1, &ID);
+        allocate();
+        cursor = region * FrameSize;
+    }
+
+    // fences the buffers the frame that just ended replaced, deletes those the GPU is done with
+    void releaseRetired()
+    {
+        for (size_t i = 0; i < retired.size();)
+        {
+            Retired& buffer = retired[i];
+            if (!buffer.fence)
+            {
+                buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                i++;
+                continue;
+            }
+            if (glClientWaitSync(buffer.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            {
+                i++;
+                continue;
+            }
+            glDeleteSync(buffer.fence);
+            glState.forgetBuffer(buffer.ID);
+            glDeleteBuffers(1, &buffer.ID);
+            retired.erase(retired.begin() + i);
+        }
+    }
+
+    void allocate()
+    {
+        glState.bindBuffer(GL_ARRAY_BUFFER, ID);
+        glBufferData(GL_ARRAY_BUFFER, FrameSize * FRAMES_IN_FLIGHT, NULL, GL_STREAM_DRAW);
+    }
+
+    void deleteFence(unsigned int region)
+    {
+        if (!fences[region]) return;
+        glDeleteSync(fences[region]);
+        fences[region] = 0;
+    }
+};
+#endif
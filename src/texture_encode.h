@@ -0,0 +1,291 @@
+#ifndef TEXTURE_ENCODE_H
+#define TEXTURE_ENCODE_H
+
+#include "cooked_texture.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// CPU side of texture cooking, shared by tools/texture_cook and the loader threads that build texture
+// array layers: resizing, mipmaps, block compression and the cooked container layout.
+
+// 8 bit texels, components channels each, rows tightly packed
+struct Image {
+    int width;
+    int height;
+    int components;
+    std::vector<unsigned char> pixels;
+};
+
+// the image with components channels, filled in the way GL reads a texture with fewer channels:
+// missing color channels are 0 and a missing alpha is opaque
+inline Image expandChannels(const Image& image, int components)
+{
+    Image expanded{ image.width, image.height, components, {} };
+    size_t texels = (size_t)image.width * image.height;
+    expanded.pixels.resize(texels * components);
+    for (size_t i = 0; i < texels; i++)
+        for (int c = 0; c < components; c++)
+        {
+            unsigned char value = c == 3 ? 255 : 0;
+            if (c < image.components && (c < 3 || image.components == 4)) value = image.pixels[i * image.components + c];
+            expanded.pixels[i * components + c] = value;
+        }
+    return expanded;
+}
+
+// bilinear resize, the texel centers of both sizes line up
+inline Image resample(const Image& image, int width, int height)
+{
+    if (image.width == width && image.height == height) return image;
+    Image resized{ width, height, image.components, {} };
+    resized.pixels.resize((size_t)width * height * image.components);
+    for (int y = 0; y < height; y++)
+    {
+        float sy = std::clamp((y + 0.5f) * image.height / height - 0.5f, 0.0f, (float)(image.height - 1));
+        int y0 = (int)sy, y1 = std::min(y0 + 1, image.height - 1);
+        float fy = sy - y0;
+        for (int x = 0; x < width; x++)
+        {
+            float sx = std::clamp((x + 0.5f) * image.width / width - 0.5f, 0.0f, (float)(image.width - 1));
+            int x0 = (int)sx, x1 = std::min(x0 + 1, image.width - 1);
+            float fx = sx - x0;
+            for (int c = 0; c < image.components; c++)
+            {
+                auto texel = [&](int tx, int ty) { return (float)image.pixels[((size_t)ty * image.width + tx) * image.components + c]; };
+                float top = texel(x0, y0) + (texel(x1, y0) - texel(x0, y0)) * fx;
+                float bottom = texel(x0, y1) + (texel(x1, y1) - texel(x0, y1)) * fx;
+                resized.pixels[((size_t)y * width + x) * image.components + c] = (unsigned char)(top + (bottom - top) * fy + 0.5f);
+            }
+        }
+    }
+    return resized;
+}
+
+// stores the first channel of alpha, resized to match, as the alpha of a 4 channel color image. Packs a
+// specular intensity map with its diffuse texture so both are read with one fetch
+inline void packAlpha(Image& color, const Image& alpha)
+{
+    Image resized = resample(alpha, color.width, color.height);
+    size_t texels = (size_t)color.width * color.height;
+    for (size_t i = 0; i < texels; i++)
+        color.pixels[i * 4 + 3] = resized.pixels[i * resized.components];
+}
+
+// half the size, each texel the average of the 2x2 texels it covers, the last row and column repeat on odd sizes
+inline Image downsample(const Image& image)
+{
+    Image half;
+    half.width = std::max(1, image.width / 2);
+    half.height = std::max(1, image.height / 2);
+    half.components = image.components;
+    half.pixels.resize((size_t)half.width * half.height * half.components);
+    for (int y = 0; y < half.height; y++)
+    {
+        int y0 = std::min(2 * y, image.height - 1), y1 = std::min(2 * y + 1, image.height - 1);
+        for (int x = 0; x < half.width; x++)
+        {
+            int x0 = std::min(2 * x, image.width - 1), x1 = std::min(2 * x + 1, image.width - 1);
+            for (int c = 0; c < image.components; c++)
+            {
+                auto texel = [&](int tx, int ty) { return (int)image.pixels[((size_t)ty * image.width + tx) * image.components + c]; };
+                int sum = texel(x0, y0) + texel(x1, y0) + texel(x0, y1) + texel(x1, y1);
+                half.pixels[((size_t)y * half.width + x) * half.components + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+    return half;
+}
+
+// levels of a full mip chain down to 1x1
+inline unsigned int mipLevelCount(int width, int height)
+{
+    unsigned int levels = 1;
+    while (width > 1 || height > 1)
+    {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        levels++;
+    }
+    return levels;
+}
+
+// block compression
+// -----------------
+// 16 values of one channel as a BC4 block: two endpoints and a 3 bit index per texel into the 8 values
+// interpolated between them. BC3 alpha and each BC5 channel use the same block.
+inline void encodeChannelBlock(const unsigned char values[16], unsigned char* out)
+{
+    unsigned char high = *std::max_element(values, values + 16);
+    unsigned char low = *std::min_element(values, values + 16);
+    out[0] = high;
+    out[1] = low;
+    // high > low selects the 8 value mode: high, low, then 6 steps from high to low
+    int palette[8] = { high, low };
+    for (int i = 2; i < 8; i++)
+        palette[i] = ((8 - i) * high + (i - 1) * low) / 7;
+
+    uint64_t indices = 0;
+    if (high != low)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            for (int p = 1; p < 8; p++)
+                if (std::abs(palette[p] - values[i]) < std::abs(palette[best] - values[i])) best = p;
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+inline uint16_t packColor(const int color[3])
+{
+    return (uint16_t)(((color[0] * 31 + 127) / 255) << 11 | ((color[1] * 63 + 127) / 255) << 5 | ((color[2] * 31 + 127) / 255));
+}
+
+inline void unpackColor(uint16_t packed, int color[3])
+{
+    int r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// 16 RGB texels as a BC1 block: two RGB565 endpoints and a 2 bit index per texel into the endpoints and the
+// two colors a third of the way between them. The endpoints are the corners of the texels' bounding box,
+// taking the diagonal the colors run along and pulled in a little to spend the precision where texels are.
+inline void encodeColorBlock(const unsigned char texels[16][3], unsigned char* out)
+{
+    int low[3] = { 255, 255, 255 }, high[3] = { 0, 0, 0 }, mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++)
+        {
+            low[c] = std::min(low[c], (int)texels[i][c]);
+            high[c] = std::max(high[c], (int)texels[i][c]);
+            mean[c] += texels[i][c];
+        }
+    for (int c = 0; c < 3; c++) mean[c] = (mean[c] + 8) / 16;
+
+    // channels that fall while the widest one rises go from high to low on the other end of the line
+    int widest = 0;
+    for (int c = 1; c < 3; c++)
+        if (high[c] - low[c] > high[widest] - low[widest]) widest = c;
+    for (int c = 0; c < 3; c++)
+    {
+        if (c == widest) continue;
+        long covariance = 0;
+        for (int i = 0; i < 16; i++)
+            covariance += (long)(texels[i][widest] - mean[widest]) * (texels[i][c] - mean[c]);
+        if (covariance < 0) std::swap(low[c], high[c]);
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        int inset = (high[c] - low[c]) / 16;
+        high[c] -= inset;
+        low[c] += inset;
+    }
+
+    uint16_t color0 = packColor(high), color1 = packColor(low);
+    // color0 > color1 selects the 4 color mode, in BC3 it is always 4 colors
+    if (color0 < color1) std::swap(color0, color1);
+    int palette[4][3];
+    unpackColor(color0, palette[0]);
+    unpackColor(color1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestDistance = 1 << 30;
+            for (int p = 0; p < 4; p++)
+            {
+                int distance = 0;
+                for (int c = 0; c < 3; c++)
+                    distance += (palette[p][c] - texels[i][c]) * (palette[p][c] - texels[i][c]);
+                if (distance < bestDistance) { best = p; bestDistance = distance; }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+    out[0] = (unsigned char)color0; out[1] = (unsigned char)(color0 >> 8);
+    out[2] = (unsigned char)color1; out[3] = (unsigned char)(color1 >> 8);
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+// one level in the given cooked format, BC1 and BC3 read missing channels as expandChannels fills them
+inline std::vector<unsigned char> encodeLevel(const Image& image, uint32_t format)
+{
+    if (!cookedCompressed(format)) return image.pixels;
+
+    int blocksX = (image.width + 3) / 4, blocksY = (image.height + 3) / 4;
+    std::vector<unsigned char> blocks(cookedLevelSize(format, image.width, image.height));
+    unsigned char* out = blocks.data();
+    for (int by = 0; by < blocksY; by++)
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            // texels of the block by channel, repeating the edge where the image ends inside it
+            unsigned char channels[4][16];
+            for (int i = 0; i < 16; i++)
+            {
+                int x = std::min(bx * 4 + i % 4, image.width - 1), y = std::min(by * 4 + i / 4, image.height - 1);
+                const unsigned char* texel = &image.pixels[((size_t)y * image.width + x) * image.components];
+                for (int c = 0; c < 4; c++)
+                    channels[c][i] = c < image.components && (c < 3 || image.components == 4) ? texel[c] : (c == 3 ? 255 : 0);
+            }
+            unsigned char color[16][3];
+            for (int i = 0; i < 16; i++)
+                for (int c = 0; c < 3; c++)
+                    color[i][c] = channels[c][i];
+
+            switch (format)
+            {
+            case COOKED_BC1: encodeColorBlock(color, out); out += 8; break;
+            case COOKED_BC3: encodeChannelBlock(channels[3], out); encodeColorBlock(color, out + 8); out += 16; break;
+            case COOKED_BC4: encodeChannelBlock(channels[0], out); out += 8; break;
+            case COOKED_BC5: encodeChannelBlock(channels[0], out); encodeChannelBlock(channels[1], out + 8); out += 16; break;
+            }
+        }
+    return blocks;
+}
+
+// the whole cooked container of image: every mip level encoded in format. Uncompressed formats have to
+// match the image's channel count.
+inline std::vector<unsigned char> cookImage(const Image& image, uint32_t format)
+{
+    std::vector<Image> levels = { image };
+    while (levels.back().width > 1 || levels.back().height > 1)
+        levels.push_back(downsample(levels.back()));
+
+    CookedHeader header;
+    std::memcpy(header.magic, COOKED_MAGIC, 4);
+    header.version = COOKED_VERSION;
+    header.format = format;
+    header.width = (uint32_t)image.width;
+    header.height = (uint32_t)image.height;
+    header.levelCount = (uint32_t)levels.size();
+
+    size_t tableSize = levels.size() * sizeof(CookedLevel);
+    std::vector<unsigned char> cooked(sizeof(CookedHeader) + tableSize);
+    std::memcpy(cooked.data(), &header, sizeof(header));
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        std::vector<unsigned char> data = encodeLevel(levels[i], format);
+        CookedLevel level{ (uint32_t)levels[i].width, (uint32_t)levels[i].height, cooked.size(), data.size() };
+        std::memcpy(cooked.data() + sizeof(CookedHeader) + i * sizeof(CookedLevel), &level, sizeof(level));
+        cooked.insert(cooked.end(), data.begin(), data.end());
+    }
+    return cooked;
+}
+#endif
@@ -0,0 +1,354 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/gl.h>
+#include <stb_image.h>
+
+#include "cooked_texture.h"
+#include "gl_state.h"
+#include "mapped_file.h"
+#include "texture_encode.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// GL_EXT_texture_compression_s3tc, not covered by the generated loader
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// A GL_TEXTURE_2D_ARRAY whose layers share one size, format and full mip chain, so every material can be
+// sampled through a single binding and picked by layer index
+struct TextureArray {
+    unsigned int ID;
+    int Width;
+    int Height;
+    unsigned int Layers;
+    unsigned int Levels;
+    // a CookedFormat
+    uint32_t Format;
+};
+
+// Asynchronous texture loading into the layers of texture arrays. loadLayer() fills the layer with a
+// placeholder right away, images are decoded by a pool of worker threads and update() streams the result to
+// the GPU through a pixel buffer object on the GL thread, so nothing waits for the disk or the decoder.
+// Uploads are spread over frames by a byte budget.
+// A layer takes the image cooked by tools/texture_cook into cookedDirectory when it is at least as new and
+// has exactly the layer's size and format: the file is memory mapped and its levels, mipmaps included, are
+// uploaded as they are. Other images are resized, mipmapped and compressed to match on the worker threads.
+class TextureLoader
+{
+public:
+    // textures whose image is resident, and textures still waiting for theirs
+    unsigned int Loaded;
+    unsigned int Pending;
+
+    // threads defaults to one less than the hardware threads, hardware_concurrency may also report 0
+    TextureLoader(const std::string& cookedDirectory = "", unsigned int threads = std::max(2u, std::thread::hardware_concurrency()) - 1) :
+        Loaded(0), Pending(0), cookedDirectory(cookedDirectory), s3tc(false), pbo(0), stopping(false)
+    {
+        if (!this->cookedDirectory.empty() && this->cookedDirectory.back() != '/') this->cookedDirectory += '/';
+        // BC1 and BC3 come from an extension every desktop driver has, BC4 and BC5 are core
+        GLint extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+        for (GLint i = 0; i < extensions; i++)
+            if (std::strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_EXT_texture_compression_s3tc") == 0) s3tc = true;
+
+        glGenBuffers(1, &pbo);
+        for (unsigned int i = 0; i < threads; i++)
+            workers.emplace_back(&TextureLoader::workerLoop, this);
+    }
+
+    ~TextureLoader()
+    {
+        stopWorkers();
+    }
+
+    // an array of layers layers of width x height, BC1 (BC3 with alpha) where the driver takes it and RGBA8
+    // otherwise. Layers hold nothing until loadLayer fills them
+    TextureArray createArray(int width, int height, unsigned int layers, bool alpha = false)
+    {
+        uint32_t format = !s3tc ? COOKED_RGBA8 : alpha ? COOKED_BC3 : COOKED_BC1;
+        TextureArray array{ 0, width, height, layers, mipLevelCount(width, height), format };
+        glGenTextures(1, &array.ID);
+        glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, array.ID);
+        for (unsigned int i = 0, w = width, h = height; i < array.Levels; i++, w = std::max(1u, w / 2), h = std::max(1u, h / 2))
+        {
+            if (cookedCompressed(array.Format))
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, glFormat(array.Format), w, h, layers, 0, (GLsizei)(cookedLevelSize(array.Format, w, h) * layers), NULL);
+            else
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_RGBA8, w, h, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, array.Levels - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return array;
+    }
+
+    // loads the image at path into layer of array, with the first channel of the image at alphaPath as its
+    // alpha if one is given. The layer shows gray until then, with an alpha of 0 while alpha is still missing
+    void loadLayer(const TextureArray& array, unsigned int layer, const char* path, const char* alphaPath = nullptr)
+    {
+        // a solid color is a single block repeated
+        unsigned char alpha = alphaPath ? 0 : 255;
+        unsigned char texel[16] = { 128, 128, 128, alpha };
+        if (array.Format != COOKED_RGBA8)
+        {
+            unsigned char texels[16][3], alphas[16];
+            std::memset(texels, 128, sizeof(texels));
+            std::memset(alphas, alpha, sizeof(alphas));
+            if (array.Format == COOKED_BC3) encodeChannelBlock(alphas, texel);
+            encodeColorBlock(texels, array.Format == COOKED_BC3 ? texel + 8 : texel);
+        }
+        size_t blockSize = cookedLevelSize(array.Format, 1, 1);
+        std::vector<unsigned char> solid(cookedLevelSize(array.Format, array.Width, array.Height));
+        for (size_t i = 0; i < solid.size(); i += blockSize)
+            std::memcpy(&solid[i], texel, blockSize);
+
+        glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, array.ID);
+        for (unsigned int i = 0, w = array.Width, h = array.Height; i < array.Levels; i++, w = std::max(1u, w / 2), h = std::max(1u, h / 2))
+            uploadLayerLevel(array, layer, i, w, h, cookedLevelSize(array.Format, w, h), solid.data());
+
+        queue(Job{ path, alphaPath ? alphaPath : "", layer, array });
+    }
+
+    // uploads decoded images until about budgetBytes were sent, at least one, call once per frame
+    void update(size_t budgetBytes = 8 << 20)
+    {
+        size_t uploaded = 0;
+        while (uploaded < budgetBytes || uploaded == 0)
+        {
+            Decoded image;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (decoded.empty()) return;
+                image = std::move(decoded.front());
+                decoded.pop_front();
+            }
+            Pending--;
+            if (!image.cooked.Data && image.encoded.empty())
+            {
+                std::cout << "Texture failed to load at path: " << image.path << std::endl;
+                continue;
+            }
+            uploaded += uploadCooked(image);
+            Loaded++;
+        }
+    }
+
+    void release()
+    {
+        stopWorkers();
+        decoded.clear();
+        glState.forgetBuffer(pbo);
+        glDeleteBuffers(1, &pbo);
+        pbo = 0;
+    }
+
+private:
+    struct Job {
+        std::string path;
+        // image whose first channel becomes the alpha of the layer, or empty
+        std::string alphaPath;
+        // layer of array to fill
+        unsigned int layer;
+        TextureArray array;
+    };
+    struct Decoded {
+        std::string path;
+        // the cooked file, mapped if one was used
+        MappedFile cooked;
+        // cooked container built by the worker when there is no matching cooked file, both are empty if
+        // decoding failed
+        std::vector<unsigned char> encoded;
+        unsigned int layer;
+        TextureArray array;
+    };
+
+    std::string cookedDirectory;
+    // whether BC1 and BC3 can be uploaded
+    bool s3tc;
+    // staging buffer the pixels go through, orphaned for every upload so the previous one is never waited for
+    unsigned int pbo;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+    std::deque<Job> jobs;
+    std::deque<Decoded> decoded;
+
+    // uploads every level of a cooked file into the layer with one copy into the pixel buffer, no mipmaps are generated
+    size_t uploadCooked(Decoded& image)
+    {
+        const unsigned char* file = image.cooked.Data ? image.cooked.Data : image.encoded.data();
+        const CookedHeader* header = (const CookedHeader*)file;
+        const CookedLevel* levels = (const CookedLevel*)(header + 1);
+        // the levels are stored one after the other behind the level table
+        uint64_t start = levels[0].offset;
+        size_t size = (size_t)(levels[header->levelCount - 1].offset + levels[header->levelCount - 1].size - start);
+        const unsigned char* data = file + start;
+
+        glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        const unsigned char* source = 0;
+        if (staging)
+        {
+            std::memcpy(staging, data, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        else
+        {
+            glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            source = data;
+        }
+
+        glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, image.array.ID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (uint32_t i = 0; i < header->levelCount; i++)
+        {
+            const void* pixels = source + (levels[i].offset - start);
+            uploadLayerLevel(image.array, image.layer, i, levels[i].width, levels[i].height, levels[i].size, pixels);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        image.cooked.close();
+        image.encoded = std::vector<unsigned char>();
+        return size;
+    }
+
+    // one level of one layer, the array has to be bound to unit 0
+    static void uploadLayerLevel(const TextureArray& array, unsigned int layer, unsigned int level, unsigned int width, unsigned int height, size_t size, const void* pixels)
+    {
+        if (cookedCompressed(array.Format))
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, glFormat(array.Format), (GLsizei)size, pixels);
+        else
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+
+    static GLenum glFormat(uint32_t format)
+    {
+        switch (format)
+        {
+        case COOKED_R8:  return GL_RED;
+        case COOKED_RG8: return GL_RG;
+        case COOKED_RGB8: return GL_RGB;
+        case COOKED_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case COOKED_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case COOKED_BC4: return GL_COMPRESSED_RED_RGTC1;
+        case COOKED_BC5: return GL_COMPRESSED_RG_RGTC2;
+        default:         return GL_RGBA;
+        }
+    }
+
+    // maps the cooked file of path when there is a usable one, it is skipped when the image, or the image
+    // packed into its alpha, is newer
+    bool mapCooked(const std::string& path, MappedFile& file, const std::string& alphaPath = "")
+    {
+        if (cookedDirectory.empty()) return false;
+        std::string cooked = cookedPath(cookedDirectory, path);
+        std::error_code error;
+        auto cookedTime = std::filesystem::last_write_time(cooked, error);
+        if (error) return false;
+        for (const std::string& source : { path, alphaPath })
+        {
+            if (source.empty()) continue;
+            auto imageTime = std::filesystem::last_write_time(source, error);
+            if (!error && imageTime > cookedTime) return false;
+        }
+
+        if (!file.open(cooked)) return false;
+        const CookedHeader* header = cookedHeader(file.Data, file.Size);
+        if (!header || ((header->format == COOKED_BC1 || header->format == COOKED_BC3) && !s3tc))
+        {
+            if (!header) std::cout << "ERROR::TEXTURE::COOKED_FILE_INVALID: " << cooked << std::endl;
+            file.close();
+            return false;
+        }
+        return true;
+    }
+
+    // finds a cooked file matching the layer, otherwise cooks the image for it
+    void encodeLayer(Decoded& image, const std::string& alphaPath)
+    {
+        const TextureArray& array = image.array;
+        if (mapCooked(image.path, image.cooked, alphaPath))
+        {
+            const CookedHeader* header = (const CookedHeader*)image.cooked.Data;
+            if (header->format == array.Format && (int)header->width == array.Width && (int)header->height == array.Height && header->levelCount == array.Levels)
+                return;
+            image.cooked.close();
+        }
+
+        Image decoded, alpha;
+        if (!decodeImage(image.path, decoded) || (!alphaPath.empty() && !decodeImage(alphaPath, alpha))) return;
+        // BC1 reads red, green and blue, the other formats and packing take four channels
+        decoded = expandChannels(decoded, array.Format == COOKED_BC1 && alphaPath.empty() ? 3 : 4);
+        if (!alphaPath.empty()) packAlpha(decoded, alpha);
+        image.encoded = cookImage(resample(decoded, array.Width, array.Height), array.Format);
+    }
+
+    static bool decodeImage(const std::string& path, Image& image)
+    {
+        unsigned char* pixels = stbi_load(path.c_str(), &image.width, &image.height, &image.components, 0);
+        if (!pixels) return false;
+        image.pixels.assign(pixels, pixels + (size_t)image.width * image.height * image.components);
+        stbi_image_free(pixels);
+        return true;
+    }
+
+    void queue(const Job& job)
+    {
+        Pending++;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+        }
+        wake.notify_one();
+    }
+
+    void workerLoop()
+    {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            Decoded image = { job.path, MappedFile(), {}, job.layer, job.array };
+            encodeLayer(image, job.alphaPath);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(std::move(image));
+        }
+    }
+
+    void stopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            if (worker.joinable()) worker.join();
+        workers.clear();
+    }
+};
+#endif
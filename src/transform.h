@@ -0,0 +1,45 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+// What a model matrix does, from cheapest to most expensive to transform normals with. Lit programs
+// are built in a variant per class, selected by the defines described in model_transform.glsl.
+enum TransformClass {
+    TRANSFORM_IDENTITY,
+    TRANSFORM_TRANSLATE,
+    // translation, rotation and a scale equal on every axis
+    TRANSFORM_UNIFORM_SCALE,
+    TRANSFORM_GENERAL
+};
+
+inline TransformClass classifyTransform(const glm::mat4& model)
+{
+    const float epsilon = 1e-5f;
+    // anything projective is general
+    if (model[0][3] != 0.0f || model[1][3] != 0.0f || model[2][3] != 0.0f || model[3][3] != 1.0f)
+        return TRANSFORM_GENERAL;
+
+    glm::vec3 x(model[0]), y(model[1]), z(model[2]);
+    bool translated = model[3][0] != 0.0f || model[3][1] != 0.0f || model[3][2] != 0.0f;
+    if (x == glm::vec3(1.0f, 0.0f, 0.0f) && y == glm::vec3(0.0f, 1.0f, 0.0f) && z == glm::vec3(0.0f, 0.0f, 1.0f))
+        return translated ? TRANSFORM_TRANSLATE : TRANSFORM_IDENTITY;
+
+    // a rotation times a uniform scale has orthogonal axes of one length
+    float scale = glm::dot(x, x);
+    float tolerance = epsilon * scale;
+    if (scale > 0.0f &&
+        std::fabs(glm::dot(y, y) - scale) <= tolerance && std::fabs(glm::dot(z, z) - scale) <= tolerance &&
+        std::fabs(glm::dot(x, y)) <= tolerance && std::fabs(glm::dot(x, z)) <= tolerance && std::fabs(glm::dot(y, z)) <= tolerance)
+        return TRANSFORM_UNIFORM_SCALE;
+    return TRANSFORM_GENERAL;
+}
+
+// inverse transpose of the upper 3x3, only needed for TRANSFORM_GENERAL
+inline glm::mat3 normalMatrix(const glm::mat4& model)
+{
+    return glm::transpose(glm::inverse(glm::mat3(model)));
+}
+#endif
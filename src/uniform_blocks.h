@@ -0,0 +1,119 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "stream_buffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// fixed binding points of the uniform blocks shared by every program
+const unsigned int FRAME_BLOCK_BINDING = 0;
+const unsigned int LIGHT_BLOCK_BINDING = 1;
+
+// The structs below mirror the std140 blocks declared in the shaders, every vec3 is followed by a float
+// so nothing needs hidden padding. Keep them in sync with the GLSL declarations.
+
+struct FrameBlock {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;
+    float pad0;
+};
+
+struct DirLight {
+    glm::vec3 direction;
+    float pad0;
+    glm::vec3 ambient;
+    float pad1;
+    glm::vec3 diffuse;
+    float pad2;
+    glm::vec3 specular;
+    float pad3;
+};
+
+// point lights are not part of a block, they are stored in a texture buffer as four RGBA32F texels
+// with this same layout, see clustered_lights.h
+struct PointLight {
+    glm::vec3 position;
+    // no light at all beyond this distance, see pointLightRadius
+    float radius;
+    glm::vec3 ambient;
+    float constant;
+    glm::vec3 diffuse;
+    float linear;
+    glm::vec3 specular;
+    float quadratic;
+};
+
+struct SpotLight {
+    glm::vec3 position;
+    float cutOff;
+    glm::vec3 direction;
+    float outerCutOff;
+    glm::vec3 ambient;
+    float constant;
+    glm::vec3 diffuse;
+    float linear;
+    glm::vec3 specular;
+    float quadratic;
+};
+
+struct LightBlock {
+    DirLight dirLight;
+    SpotLight spotLight;
+    // tiles across, tiles down, depth slices and number of point lights of the light clusters
+    int clusterGrid[4];
+    // depth slice of a view depth d is log(d) * clusterScale - clusterBias
+    float clusterScale;
+    float clusterBias;
+    float pad0;
+    float pad1;
+};
+
+static_assert(sizeof(FrameBlock) == 144, "FrameBlock does not match std140");
+static_assert(sizeof(DirLight) == 64 && sizeof(PointLight) == 64 && sizeof(SpotLight) == 80, "light structs do not match std140");
+static_assert(offsetof(LightBlock, clusterGrid) == 144 && offsetof(LightBlock, clusterScale) == 160, "LightBlock does not match std140");
+
+// One T shared by every program through a fixed binding point. The block is written into the frame's region
+// of the stream buffer and that range is bound, so it has to be updated every frame. Updates within a frame
+// are skipped when the contents did not change.
+template<typename T>
+class UniformBuffer
+{
+public:
+    UniformBuffer(StreamBuffer& stream, unsigned int binding) : stream(stream), binding(binding), current(), frame(0), uploaded(false)
+    {
+        // programs drawn before the first update still find a block bound
+        write(current);
+    }
+
+    // the caller should build data from a zeroed T so the padding members compare equal
+    void update(const T& data)
+    {
+        if (uploaded && frame == stream.Frame && std::memcmp(&current, &data, sizeof(T)) == 0) return;
+        write(data);
+        current = data;
+        uploaded = true;
+    }
+
+private:
+    StreamBuffer& stream;
+    unsigned int binding;
+    T current;
+    // frame of the stream the bound copy was written in
+    uint64_t frame;
+    bool uploaded;
+
+    void write(const T& data)
+    {
+        GLintptr offset = stream.write(&data, sizeof(T), stream.UniformAlignment);
+        glState.bindBufferRange(GL_UNIFORM_BUFFER, binding, stream.ID, offset, sizeof(T));
+        frame = stream.Frame;
+    }
+};
+#endif
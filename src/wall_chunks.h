@@ -0,0 +1,264 @@
+#ifndef WALL_CHUNKS_H
+#define WALL_CHUNKS_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "map.h"
+#include "wall_mesh.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// cells per side of a chunk
+const int CHUNK_SIZE = 16;
+
+struct WallChunk {
+    // first cell covered by the chunk
+    int row;
+    int col;
+    unsigned int VAO;
+    unsigned int VBO;
+    unsigned int VertexCount;
+    // number of wall cells inside the chunk
+    unsigned int WallCount;
+    // world space bounds of the chunk
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    // bumped by every edit inside the chunk, results built from an older version are thrown away
+    unsigned int version;
+    bool dirty;
+    bool pending;
+};
+
+// The labyrinth split into CHUNK_SIZE x CHUNK_SIZE meshes. Editing a cell only remeshes the chunks that
+// can see it, and the meshing runs on a worker thread so edits never stall the frame.
+class WallChunks
+{
+public:
+    std::vector<WallChunk> Chunks;
+    int ChunkRows;
+    int ChunkCols;
+    // bumped every time a chunk mesh is uploaded
+    unsigned int Revision;
+
+    WallChunks() : ChunkRows(0), ChunkCols(0), Revision(0), stopping(false)
+    {
+        worker = std::thread(&WallChunks::workerLoop, this);
+    }
+
+    ~WallChunks()
+    {
+        stopWorker();
+    }
+
+    // (re)creates the chunks for the current size of the labyrinth and meshes all of them right away
+    void build()
+    {
+        releaseChunks();
+
+        int rows = (int)labyrinth.size();
+        int cols = rows > 0 ? (int)labyrinth[0].size() : 0;
+        ChunkRows = (rows + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        ChunkCols = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+        Chunks.resize(ChunkRows * ChunkCols);
+        for (int cr = 0; cr < ChunkRows; cr++) {
+            for (int cc = 0; cc < ChunkCols; cc++) {
+                WallChunk& chunk = Chunks[cr * ChunkCols + cc];
+                chunk.row = cr * CHUNK_SIZE;
+                chunk.col = cc * CHUNK_SIZE;
+                chunk.VertexCount = 0;
+                chunk.version = 0;
+                chunk.dirty = false;
+                chunk.pending = false;
+                chunk.boundsMin = glm::vec3((float)chunk.col, 0.0f, (float)chunk.row);
+                chunk.boundsMax = glm::vec3((float)std::min(chunk.col + CHUNK_SIZE, cols), BLOCK_SIDE, (float)std::min(chunk.row + CHUNK_SIZE, rows));
+                createBuffers(chunk);
+
+                WallMesher mesher(labyrinth);
+                int rowEnd = std::min(chunk.row + CHUNK_SIZE, rows);
+                int colEnd = std::min(chunk.col + CHUNK_SIZE, cols);
+                chunk.WallCount = mesher.countWalls(chunk.row, rowEnd, chunk.col, colEnd);
+                upload(chunk, mesher.build(chunk.row, rowEnd, chunk.col, colEnd));
+            }
+        }
+    }
+
+    // marks the chunk holding a changed cell dirty, plus the neighbouring chunks whose border faces depend on it
+    void markCell(int row, int col)
+    {
+        markChunk(row / CHUNK_SIZE, col / CHUNK_SIZE);
+        if (row % CHUNK_SIZE == 0)              markChunk(row / CHUNK_SIZE - 1, col / CHUNK_SIZE);
+        if (row % CHUNK_SIZE == CHUNK_SIZE - 1) markChunk(row / CHUNK_SIZE + 1, col / CHUNK_SIZE);
+        if (col % CHUNK_SIZE == 0)              markChunk(row / CHUNK_SIZE, col / CHUNK_SIZE - 1);
+        if (col % CHUNK_SIZE == CHUNK_SIZE - 1) markChunk(row / CHUNK_SIZE, col / CHUNK_SIZE + 1);
+    }
+
+    // sends dirty chunks to the worker and uploads the meshes it finished, call once per frame
+    void update()
+    {
+        for (int i = 0; i < (int)Chunks.size(); i++) {
+            WallChunk& chunk = Chunks[i];
+            if (!chunk.dirty || chunk.pending) continue;
+            chunk.dirty = false;
+            chunk.pending = true;
+            queueJob(i, chunk);
+        }
+
+        std::deque<Result> finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.swap(results);
+        }
+        for (Result& result : finished) {
+            WallChunk& chunk = Chunks[result.chunk];
+            chunk.pending = false;
+            // edited again while the worker was busy, it is already dirty and will be queued again
+            if (result.version != chunk.version) continue;
+            chunk.WallCount = result.walls;
+            upload(chunk, result.vertices);
+        }
+    }
+
+    void release()
+    {
+        stopWorker();
+        releaseChunks();
+    }
+
+private:
+    // the worker gets a copy of the chunk cells plus a one cell border, it never touches labyrinth
+    struct Job {
+        int chunk;
+        unsigned int version;
+        std::vector<std::vector<int>> cells;
+        int rowOffset;
+        int colOffset;
+        int rowBegin, rowEnd, colBegin, colEnd;
+    };
+    struct Result {
+        int chunk;
+        unsigned int version;
+        std::vector<float> vertices;
+        unsigned int walls;
+    };
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> jobs;
+    std::deque<Result> results;
+    bool stopping;
+
+    void markChunk(int chunkRow, int chunkCol)
+    {
+        if (chunkRow < 0 || chunkRow >= ChunkRows || chunkCol < 0 || chunkCol >= ChunkCols) return;
+        WallChunk& chunk = Chunks[chunkRow * ChunkCols + chunkCol];
+        chunk.version++;
+        chunk.dirty = true;
+    }
+
+    void queueJob(int index, const WallChunk& chunk)
+    {
+        int rows = (int)labyrinth.size();
+        int cols = (int)labyrinth[0].size();
+
+        Job job;
+        job.chunk = index;
+        job.version = chunk.version;
+        job.rowOffset = std::max(chunk.row - 1, 0);
+        job.colOffset = std::max(chunk.col - 1, 0);
+        int rowLast = std::min(chunk.row + CHUNK_SIZE + 1, rows);
+        int colLast = std::min(chunk.col + CHUNK_SIZE + 1, cols);
+        for (int r = job.rowOffset; r < rowLast; r++)
+            job.cells.emplace_back(labyrinth[r].begin() + job.colOffset, labyrinth[r].begin() + colLast);
+        job.rowBegin = chunk.row - job.rowOffset;
+        job.rowEnd = std::min(chunk.row + CHUNK_SIZE, rows) - job.rowOffset;
+        job.colBegin = chunk.col - job.colOffset;
+        job.colEnd = std::min(chunk.col + CHUNK_SIZE, cols) - job.colOffset;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        wake.notify_one();
+    }
+
+    void workerLoop()
+    {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            WallMesher mesher(job.cells, job.rowOffset, job.colOffset);
+            Result result;
+            result.chunk = job.chunk;
+            result.version = job.version;
+            result.vertices = mesher.build(job.rowBegin, job.rowEnd, job.colBegin, job.colEnd);
+            result.walls = mesher.countWalls(job.rowBegin, job.rowEnd, job.colBegin, job.colEnd);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            results.push_back(std::move(result));
+        }
+    }
+
+    void stopWorker()
+    {
+        if (!worker.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    static void createBuffers(WallChunk& chunk)
+    {
+        glGenVertexArrays(1, &chunk.VAO);
+        glGenBuffers(1, &chunk.VBO);
+        glState.bindVertexArray(chunk.VAO);
+        glState.bindBuffer(GL_ARRAY_BUFFER, chunk.VBO);
+        // position attribute
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        // normal attribute
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        // texture attribute
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+    }
+
+    void upload(WallChunk& chunk, const std::vector<float>& vertices)
+    {
+        Revision++;
+        glState.bindBuffer(GL_ARRAY_BUFFER, chunk.VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+        chunk.VertexCount = (unsigned int)(vertices.size() / 8);
+    }
+
+    void releaseChunks()
+    {
+        for (WallChunk& chunk : Chunks) {
+            glState.forgetVertexArray(chunk.VAO);
+            glState.forgetBuffer(chunk.VBO);
+            glDeleteVertexArrays(1, &chunk.VAO);
+            glDeleteBuffers(1, &chunk.VBO);
+        }
+        Chunks.clear();
+    }
+};
+#endif
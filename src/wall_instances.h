@@ -0,0 +1,159 @@
+#ifndef WALL_INSTANCES_H
+#define WALL_INSTANCES_H
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "frustum.h"
+#include "gl_state.h"
+#include "map.h"
+#include "pvs.h"
+#include "stream_buffer.h"
+#include "wall_chunks.h"
+
+#include <algorithm>
+#include <vector>
+
+// Per-instance offsets of every wall cell of the labyrinth, so all the walls can be drawn with a single instanced draw call.
+// Offsets are grouped per CHUNK_SIZE x CHUNK_SIZE block so culling can reject whole blocks before looking at cells.
+// The full list stays in VBO until the map changes, the walls left by culling change every frame and are written
+// into the stream buffer.
+class WallInstances
+{
+public:
+    unsigned int VBO;
+    // number of wall instances the attached VAO currently reads
+    unsigned int Count;
+    // number of wall cells in the labyrinth
+    unsigned int Total;
+
+    WallInstances(StreamBuffer& stream) : VBO(0), Count(0), Total(0), stream(stream), VAO(0), source(0), sourceOffset(0), blockCols(0),
+        revision(0), built(false), uploadedAll(false)
+    {
+        glGenBuffers(1, &VBO);
+    }
+
+    // adds the instance offset attribute (location 3) to a VAO that already holds the cube vertices
+    void attach(unsigned int VAO)
+    {
+        this->VAO = VAO;
+        glState.bindVertexArray(VAO);
+        glEnableVertexAttribArray(3);
+        glVertexAttribDivisor(3, 1);
+        source = 0;
+        point(VBO, 0);
+    }
+
+    // regroups the offsets if the map changed since the last call
+    void update()
+    {
+        if (built && revision == mapRevision) return;
+
+        int rows = (int)labyrinth.size();
+        int cols = rows > 0 ? (int)labyrinth[0].size() : 0;
+        blockCols = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        blocks.assign(((rows + CHUNK_SIZE - 1) / CHUNK_SIZE) * blockCols, Block());
+        for (int b = 0; b < (int)blocks.size(); b++) {
+            int row = (b / blockCols) * CHUNK_SIZE;
+            int col = (b % blockCols) * CHUNK_SIZE;
+            blocks[b].row = row;
+            blocks[b].col = col;
+            blocks[b].boundsMin = glm::vec3((float)col, 0.0f, (float)row);
+            blocks[b].boundsMax = glm::vec3((float)std::min(col + CHUNK_SIZE, cols), BLOCK_SIDE, (float)std::min(row + CHUNK_SIZE, rows));
+        }
+
+        Total = 0;
+        for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < cols; j++) {
+                if (labyrinth[i][j] == 0) continue;
+                Block& block = blocks[(i / CHUNK_SIZE) * blockCols + j / CHUNK_SIZE];
+                block.offsets.push_back(glm::vec3(j + BLOCK_SIDE / 2, BLOCK_SIDE / 2, i + BLOCK_SIDE / 2));
+                Total++;
+            }
+        }
+
+        revision = mapRevision;
+        built = true;
+        uploadedAll = false;
+    }
+
+    // draws every wall, only touches the buffer if the walls changed
+    void uploadAll()
+    {
+        if (!uploadedAll)
+        {
+            visible.clear();
+            for (const Block& block : blocks)
+                visible.insert(visible.end(), block.offsets.begin(), block.offsets.end());
+            glState.bindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBufferData(GL_ARRAY_BUFFER, visible.size() * sizeof(glm::vec3), visible.data(), GL_STATIC_DRAW);
+            uploadedAll = true;
+        }
+        point(VBO, 0);
+        Count = Total;
+    }
+
+    // uploads only the walls inside the frustum, returns the number of walls culled.
+    // with a pvs and the cell the camera is in, walls that cannot be seen from that cell are dropped too.
+    unsigned int cull(const Frustum& frustum, const PotentiallyVisibleSet* pvs = nullptr, int viewCell = -1)
+    {
+        bool usePvs = pvs != nullptr && viewCell >= 0;
+        visible.clear();
+        for (const Block& block : blocks) {
+            if (usePvs && !pvs->anyVisible(viewCell, block.row, block.row + CHUNK_SIZE, block.col, block.col + CHUNK_SIZE)) continue;
+            FrustumTest result = frustum.test(block.boundsMin, block.boundsMax);
+            if (result == FRUSTUM_OUTSIDE) continue;
+            glm::vec3 half(BLOCK_SIDE / 2);
+            for (const glm::vec3& offset : block.offsets) {
+                if (usePvs && !pvs->visible(viewCell, (int)offset.z, (int)offset.x)) continue;
+                if (result == FRUSTUM_INSIDE || frustum.visible(offset - half, offset + half)) visible.push_back(offset);
+            }
+        }
+        // the visible walls change every frame, they go to the stream buffer and the full list stays in VBO
+        GLintptr offset = stream.write(visible.data(), visible.size() * sizeof(glm::vec3));
+        point(stream.ID, offset);
+        Count = (unsigned int)visible.size();
+        return Total - Count;
+    }
+
+    void release()
+    {
+        glState.forgetBuffer(VBO);
+        glDeleteBuffers(1, &VBO);
+        VBO = 0;
+        Count = 0;
+    }
+
+private:
+    struct Block {
+        int row;
+        int col;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        std::vector<glm::vec3> offsets;
+    };
+
+    StreamBuffer& stream;
+    unsigned int VAO;
+    // buffer and offset the VAO's instance attribute reads from
+    unsigned int source;
+    GLintptr sourceOffset;
+    std::vector<Block> blocks;
+    int blockCols;
+    std::vector<glm::vec3> visible;
+    unsigned int revision;
+    bool built;
+    bool uploadedAll;
+
+    // sets where the instance offset attribute of the VAO reads from
+    void point(unsigned int buffer, GLintptr offset)
+    {
+        if (buffer == source && offset == sourceOffset) return;
+        glState.bindVertexArray(VAO);
+        glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)offset);
+        source = buffer;
+        sourceOffset = offset;
+    }
+};
+#endif
@@ -0,0 +1,175 @@
+#ifndef WALL_MESH_H
+#define WALL_MESH_H
+
+#include <glm/glm.hpp>
+
+#include "map.h"
+
+#include <utility>
+#include <vector>
+
+// Turns a grid of wall cells into the faces that can actually be seen: faces shared by two walls and
+// the bottom faces resting on the floor are dropped, and coplanar neighbouring faces are greedily merged
+// into bigger quads whose texture coordinates keep tiling once per cell.
+// Output is GL_TRIANGLES with the same layout as cubeVertices: position, normal, texture coords.
+class WallMesher
+{
+public:
+    // cells is the grid to read, rowOffset/colOffset is the world position of cells[0][0].
+    // cells outside of the grid are treated as open.
+    WallMesher(const std::vector<std::vector<int>>& cells, int rowOffset = 0, int colOffset = 0)
+        : cells(cells), rowOffset(rowOffset), colOffset(colOffset)
+    {
+    }
+
+    // meshes the cells in rows [rowBegin, rowEnd) and columns [colBegin, colEnd) of the grid
+    std::vector<float> build(int rowBegin, int rowEnd, int colBegin, int colEnd) const
+    {
+        std::vector<float> vertices;
+        buildTops(rowBegin, rowEnd, colBegin, colEnd, vertices);
+        buildSidesZ(rowBegin, rowEnd, colBegin, colEnd, -1, vertices);
+        buildSidesZ(rowBegin, rowEnd, colBegin, colEnd, 1, vertices);
+        buildSidesX(rowBegin, rowEnd, colBegin, colEnd, -1, vertices);
+        buildSidesX(rowBegin, rowEnd, colBegin, colEnd, 1, vertices);
+        return vertices;
+    }
+
+    // number of wall cells in the same range
+    int countWalls(int rowBegin, int rowEnd, int colBegin, int colEnd) const
+    {
+        int walls = 0;
+        for (int r = rowBegin; r < rowEnd; r++)
+            for (int c = colBegin; c < colEnd; c++)
+                if (isWall(r, c)) walls++;
+        return walls;
+    }
+
+private:
+    const std::vector<std::vector<int>>& cells;
+    int rowOffset;
+    int colOffset;
+
+    bool isWall(int row, int col) const
+    {
+        if (row < 0 || row >= (int)cells.size()) return false;
+        if (col < 0 || col >= (int)cells[row].size()) return false;
+        return cells[row][col] != 0;
+    }
+
+    // top faces, merged into rectangles
+    void buildTops(int rowBegin, int rowEnd, int colBegin, int colEnd, std::vector<float>& vertices) const
+    {
+        int rows = rowEnd - rowBegin;
+        int cols = colEnd - colBegin;
+        std::vector<char> used(rows * cols, 0);
+
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+                if (used[r * cols + c] || !isWall(rowBegin + r, colBegin + c)) continue;
+
+                // grow along the row as far as possible, then grow down while the whole span is free
+                int width = 1;
+                while (c + width < cols && !used[r * cols + c + width] && isWall(rowBegin + r, colBegin + c + width))
+                    width++;
+                int height = 1;
+                while (r + height < rows && spanFree(rowBegin + r + height, colBegin + c, width, used, (r + height) * cols + c))
+                    height++;
+
+                for (int y = 0; y < height; y++)
+                    for (int x = 0; x < width; x++)
+                        used[(r + y) * cols + c + x] = 1;
+
+                float x0 = (float)(colOffset + colBegin + c);
+                float z0 = (float)(rowOffset + rowBegin + r);
+                float x1 = x0 + width * BLOCK_SIDE;
+                float z1 = z0 + height * BLOCK_SIDE;
+                float y = BLOCK_SIDE;
+                // same orientation as the top face of cubeVertices: u along x, v against z
+                quad(vertices, glm::vec3(0.0f, 1.0f, 0.0f),
+                     glm::vec3(x0, y, z0), glm::vec2(0.0f, (float)height),
+                     glm::vec3(x1, y, z0), glm::vec2((float)width, (float)height),
+                     glm::vec3(x1, y, z1), glm::vec2((float)width, 0.0f),
+                     glm::vec3(x0, y, z1), glm::vec2(0.0f, 0.0f));
+            }
+        }
+    }
+
+    bool spanFree(int row, int col, int width, const std::vector<char>& used, int usedIndex) const
+    {
+        for (int x = 0; x < width; x++) {
+            if (used[usedIndex + x] || !isWall(row, col + x)) return false;
+        }
+        return true;
+    }
+
+    // faces looking towards -z (side = -1) or +z (side = 1), merged along x.
+    // walls all have the same height, so runs along the row are the best merge available.
+    void buildSidesZ(int rowBegin, int rowEnd, int colBegin, int colEnd, int side, std::vector<float>& vertices) const
+    {
+        for (int r = rowBegin; r < rowEnd; r++) {
+            int c = colBegin;
+            while (c < colEnd) {
+                if (!isWall(r, c) || isWall(r + side, c)) { c++; continue; }
+                int start = c;
+                while (c < colEnd && isWall(r, c) && !isWall(r + side, c)) c++;
+                int length = c - start;
+
+                float x0 = (float)(colOffset + start);
+                float x1 = x0 + length * BLOCK_SIDE;
+                float z = (float)(rowOffset + r) + (side > 0 ? BLOCK_SIDE : 0.0f);
+                quad(vertices, glm::vec3(0.0f, 0.0f, (float)side),
+                     glm::vec3(x0, 0.0f, z), glm::vec2(0.0f, 0.0f),
+                     glm::vec3(x1, 0.0f, z), glm::vec2((float)length, 0.0f),
+                     glm::vec3(x1, BLOCK_SIDE, z), glm::vec2((float)length, 1.0f),
+                     glm::vec3(x0, BLOCK_SIDE, z), glm::vec2(0.0f, 1.0f));
+            }
+        }
+    }
+
+    // faces looking towards -x (side = -1) or +x (side = 1), merged along z
+    void buildSidesX(int rowBegin, int rowEnd, int colBegin, int colEnd, int side, std::vector<float>& vertices) const
+    {
+        for (int c = colBegin; c < colEnd; c++) {
+            int r = rowBegin;
+            while (r < rowEnd) {
+                if (!isWall(r, c) || isWall(r, c + side)) { r++; continue; }
+                int start = r;
+                while (r < rowEnd && isWall(r, c) && !isWall(r, c + side)) r++;
+                int length = r - start;
+
+                float z0 = (float)(rowOffset + start);
+                float z1 = z0 + length * BLOCK_SIDE;
+                float x = (float)(colOffset + c) + (side > 0 ? BLOCK_SIDE : 0.0f);
+                // the x faces of cubeVertices run u up the wall and v against z
+                quad(vertices, glm::vec3((float)side, 0.0f, 0.0f),
+                     glm::vec3(x, 0.0f, z0), glm::vec2(0.0f, (float)length),
+                     glm::vec3(x, 0.0f, z1), glm::vec2(0.0f, 0.0f),
+                     glm::vec3(x, BLOCK_SIDE, z1), glm::vec2(1.0f, 0.0f),
+                     glm::vec3(x, BLOCK_SIDE, z0), glm::vec2(1.0f, (float)length));
+            }
+        }
+    }
+
+    // emits two triangles, wound counter-clockwise when seen from the side the normal points to
+    static void quad(std::vector<float>& vertices, glm::vec3 normal,
+                     glm::vec3 p0, glm::vec2 t0, glm::vec3 p1, glm::vec2 t1,
+                     glm::vec3 p2, glm::vec2 t2, glm::vec3 p3, glm::vec2 t3)
+    {
+        if (glm::dot(glm::cross(p1 - p0, p2 - p0), normal) < 0.0f) {
+            std::swap(p1, p3);
+            std::swap(t1, t3);
+        }
+        vertex(vertices, p0, normal, t0);
+        vertex(vertices, p1, normal, t1);
+        vertex(vertices, p2, normal, t2);
+        vertex(vertices, p2, normal, t2);
+        vertex(vertices, p3, normal, t3);
+        vertex(vertices, p0, normal, t0);
+    }
+
+    static void vertex(std::vector<float>& vertices, glm::vec3 p, glm::vec3 n, glm::vec2 t)
+    {
+        vertices.insert(vertices.end(), { p.x, p.y, p.z, n.x, n.y, n.z, t.x, t.y });
+    }
+};
+#endif
@@ -0,0 +1,119 @@
+// Cooks an image into the container described in src/cooked_texture.h. Every mip level is built on the CPU
+// with a box filter and, unless --uncompressed is given, block compressed: BC4 for one channel, BC5 for two,
+// BC1 for color and BC3 for color with alpha that is not fully opaque.
+// --alpha stores the first channel of a second image as alpha, --size resizes the result and --format picks
+// the format instead, adding channels the image lacks, which is what texture array layers need to share one.
+//   texture_cook [--uncompressed] [--alpha <image>] [--size <width>x<height>] [--format <format>] <image> <output.ctex>
+#include <stb_image.h>
+
+#include "cooked_texture.h"
+#include "texture_encode.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+uint32_t chooseFormat(const Image& image, bool compressed)
+{
+    switch (image.components)
+    {
+    case 1: return compressed ? COOKED_BC4 : COOKED_R8;
+    case 2: return compressed ? COOKED_BC5 : COOKED_RG8;
+    case 3: return compressed ? COOKED_BC1 : COOKED_RGB8;
+    }
+    if (!compressed) return COOKED_RGBA8;
+    // BC1 is half the size of BC3, use it when the alpha says nothing
+    for (size_t i = 3; i < image.pixels.size(); i += 4)
+        if (image.pixels[i] != 255) return COOKED_BC3;
+    return COOKED_BC1;
+}
+
+const char* FORMAT_NAMES[COOKED_FORMAT_COUNT] = { "R8", "RG8", "RGB8", "RGBA8", "BC1", "BC3", "BC4", "BC5" };
+// channels an image needs for each format
+const int FORMAT_COMPONENTS[COOKED_FORMAT_COUNT] = { 1, 2, 3, 4, 3, 4, 1, 2 };
+
+bool loadImage(const std::string& path, Image& image)
+{
+    unsigned char* pixels = stbi_load(path.c_str(), &image.width, &image.height, &image.components, 0);
+    if (!pixels)
+    {
+        std::cout << "ERROR::TEXTURE_COOK::LOAD_FAILED: " << path << std::endl;
+        return false;
+    }
+    image.pixels.assign(pixels, pixels + (size_t)image.width * image.height * image.components);
+    stbi_image_free(pixels);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    bool compressed = true;
+    int width = 0, height = 0;
+    uint32_t format = COOKED_FORMAT_COUNT;
+    std::string alphaPath;
+    bool valid = true;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--uncompressed") == 0) compressed = false;
+        else if (std::strcmp(argv[i], "--alpha") == 0 && i + 1 < argc) alphaPath = argv[++i];
+        else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+            valid = std::sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0;
+        else if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)std::toupper(c); });
+            for (format = 0; format < COOKED_FORMAT_COUNT; format++)
+                if (name == FORMAT_NAMES[format]) break;
+            valid = format < COOKED_FORMAT_COUNT;
+        }
+        else paths.push_back(argv[i]);
+    }
+    if (!valid || paths.size() != 2)
+    {
+        std::cout << "usage: texture_cook [--uncompressed] [--alpha <image>] [--size <width>x<height>] [--format <format>] <image> <output"
+            << COOKED_EXTENSION << ">" << std::endl;
+        return 1;
+    }
+
+    Image image;
+    if (!loadImage(paths[0], image)) return 1;
+    if (!alphaPath.empty())
+    {
+        Image alpha;
+        if (!loadImage(alphaPath, alpha)) return 1;
+        image = expandChannels(image, 4);
+        packAlpha(image, alpha);
+    }
+    if (width > 0) image = resample(image, width, height);
+
+    if (format == COOKED_FORMAT_COUNT)
+        format = chooseFormat(image, compressed);
+    else if (image.components != FORMAT_COMPONENTS[format])
+        image = expandChannels(image, FORMAT_COMPONENTS[format]);
+    std::vector<unsigned char> cooked = cookImage(image, format);
+
+    std::ofstream file(paths[1], std::ios::binary | std::ios::trunc);
+    file.write((const char*)cooked.data(), cooked.size());
+    if (!file)
+    {
+        std::cout << "ERROR::TEXTURE_COOK::WRITE_FAILED: " << paths[1] << std::endl;
+        return 1;
+    }
+
+    // what the same levels take in video memory as RGBA8
+    const CookedHeader* header = (const CookedHeader*)cooked.data();
+    const CookedLevel* levels = (const CookedLevel*)(header + 1);
+    uint64_t rgba = 0;
+    for (uint32_t i = 0; i < header->levelCount; i++)
+        rgba += (uint64_t)levels[i].width * levels[i].height * 4;
+    std::cout << "Cooked " << paths[0] << ": " << image.width << "x" << image.height << ", " << header->levelCount << " levels, "
+        << FORMAT_NAMES[format] << ", " << cooked.size() << " bytes (" << rgba << " as RGBA8)" << std::endl;
+    return 0;
+}